@@ -0,0 +1,478 @@
+#include <errno.h>
+#include <getopt.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "common/err.h"
+
+
+/*
+ * Benchmark of the solvers on a fixed corpus of inputs.
+ * Runs nonrecursive once and parallel once per thread count on every instance,
+ * keeping the fastest of the repetitions, and reports wall time, expanded nodes
+ * per second, speedup and efficiency of parallel over its single-thread run (which
+ * is always measured), and peak RSS. The solvers are those built alongside.
+ * Results are written as JSON, one run per line, and can be compared with those
+ * of an earlier commit given as the baseline. The options of --parallel-options are
+ * passed to every run of parallel, e.g. "--affinity scatter --steal any" for a
+ * baseline to compare local steals against.
+ *
+ * Usage: scaling [--corpus quick|full] [--threads 1,2,4] [--repetitions r]
+ *                [--output file] [--baseline file] [--tolerance fraction]
+ *                [--parallel-options "options"]
+ */
+
+// Constants
+enum {
+    ERROR = 1,
+    REGRESSION = 2,            // Exit status when a run is slower than its baseline
+    MAX_THREAD_COUNTS = 16,
+    MAX_RUNS = 256,
+    OUTPUT_SIZE = 4096,        // Bytes of solver output kept
+    MAX_SOLVER_ARGS = 32       // Arguments of a solver, with its path and the final NULL
+};
+
+// An input of the corpus. The thread count is filled in per run.
+typedef struct {
+    const char* name;
+    int d;
+    int a_size;
+    const char* a_start;       // Elements of a_start, separated by spaces
+    int b_size;
+    const char* b_start;
+    bool full;                 // Only part of the full corpus
+} Instance;
+
+// Sizes chosen so that nonrecursive takes from a tenth of a second to a few seconds.
+static const Instance corpus[] = {
+    {"d17", 17, 0, "", 0, "", false},
+    {"d18", 18, 0, "", 0, "", false},
+    {"d25-a3-b4", 25, 1, "3", 1, "4", false},
+    {"d26-a5-b6", 26, 1, "5", 1, "6", false},
+    {"d20", 20, 0, "", 0, "", false},
+    {"d21", 21, 0, "", 0, "", true},
+    {"d23-a1", 23, 1, "1", 0, "", true},
+    {"d22", 22, 0, "", 0, "", true},
+};
+
+typedef struct {
+    const char* corpus;        // "quick" or "full"
+    int threads[MAX_THREAD_COUNTS];
+    int threads_count;
+    int repetitions;
+    const char* output;        // JSON file (or NULL for stdout)
+    const char* baseline;      // JSON file of an earlier run (or NULL)
+    double tolerance;          // Allowed slowdown against the baseline
+    const char* parallel_options; // Extra arguments of parallel, separated by spaces
+    char* parallel_args[MAX_SOLVER_ARGS]; // The same, split and NULL terminated
+} Options;
+
+// Result of one solver on one instance, the fastest of the repetitions.
+typedef struct {
+    const char* instance;
+    const char* solver;
+    int threads;
+    double wall;               // Seconds
+    long long nodes;           // Expanded nodes, from --stats
+    long long steals;          // Frames stolen (0 for nonrecursive or without counters)
+    long long remote_steals;   // Of them, frames stolen from a thread on another NUMA node
+    long peak_rss;             // Kilobytes, maximum over the repetitions
+    int sum;                   // Sum of the solution found
+    double speedup;            // Over parallel with one thread (0 if not measured)
+} Run;
+
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Read from fd until end of file, keeping the first size - 1 bytes as a string.
+static void read_all(int fd, char* buffer, size_t size) {
+    size_t length = 0;
+    char discard[512];
+
+    while (true) {
+        ssize_t count = length + 1 < size ? read(fd, buffer + length, size - 1 - length)
+                                          : read(fd, discard, sizeof(discard));
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+        if (count <= 0) {
+            break;
+        }
+        if (length + 1 < size) {
+            length += count;
+        }
+    }
+
+    buffer[length] = '\0';
+}
+
+/*
+ * Run the solver at path once on the input, with --stats and the extra arguments (or
+ * NULL). Fills wall, nodes, steals, peak_rss and sum of the run. Returns false if the
+ * solver failed.
+ */
+static bool run_once(const char* path, char* const* extra, const char* input, Run* run) {
+    int in[2], out[2], err[2];
+    ASSERT_SYS_OK(pipe(in));
+    ASSERT_SYS_OK(pipe(out));
+    ASSERT_SYS_OK(pipe(err));
+
+    double start = now();
+    pid_t pid;
+    ASSERT_SYS_OK(pid = fork());
+
+    if (pid == 0) {
+        ASSERT_SYS_OK(dup2(in[0], STDIN_FILENO));
+        ASSERT_SYS_OK(dup2(out[1], STDOUT_FILENO));
+        ASSERT_SYS_OK(dup2(err[1], STDERR_FILENO));
+        for (int k = 0; k < 2; ++k) {
+            close(in[k]);
+            close(out[k]);
+            close(err[k]);
+        }
+
+        char* args[MAX_SOLVER_ARGS] = {(char*)path, "--stats"};
+        for (int k = 0; extra && extra[k]; ++k) {
+            args[k + 2] = extra[k];
+        }
+
+        execv(path, args);
+        syserr("exec %s", path);
+    }
+
+    ASSERT_SYS_OK(close(in[0]));
+    ASSERT_SYS_OK(close(out[1]));
+    ASSERT_SYS_OK(close(err[1]));
+
+    // Inputs are a few dozen bytes, far below the pipe capacity.
+    ASSERT_SYS_OK(write(in[1], input, strlen(input)));
+    ASSERT_SYS_OK(close(in[1]));
+
+    // The stats on stderr are a few lines, they fit in the pipe while stdout is read.
+    char output[OUTPUT_SIZE], stats[OUTPUT_SIZE];
+    read_all(out[0], output, sizeof(output));
+    read_all(err[0], stats, sizeof(stats));
+    ASSERT_SYS_OK(close(out[0]));
+    ASSERT_SYS_OK(close(err[0]));
+
+    int status;
+    struct rusage usage;
+    ASSERT_SYS_OK(wait4(pid, &status, 0, &usage));
+    run->wall = now() - start;
+    run->peak_rss = usage.ru_maxrss;
+
+    const char* nodes = strstr(stats, "nodes: ");
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0 || sscanf(output, "%d", &run->sum) != 1 || !nodes) {
+        fprintf(stderr, "%s failed on %s:\n%s", path, run->instance, stats);
+        return false;
+    }
+    run->nodes = atoll(nodes + strlen("nodes: "));
+
+    // "steals: 12, 3 failed, 4 remote"
+    const char* steals = strstr(stats, "\nsteals: ");
+    run->steals = 0;
+    run->remote_steals = 0;
+    if (steals) {
+        long long failed;
+        sscanf(steals, "\nsteals: %lld, %lld failed, %lld remote", &run->steals, &failed, &run->remote_steals);
+    }
+
+    return true;
+}
+
+// Run a solver the given number of times, keeping the fastest run and the largest RSS.
+static bool run_best(const char* path, char* const* extra, const char* input, int repetitions, Run* run) {
+    Run best = *run;
+    best.wall = 0;
+    best.peak_rss = 0;
+
+    for (int r = 0; r < repetitions; ++r) {
+        Run attempt = *run;
+
+        if (!run_once(path, extra, input, &attempt)) {
+            return false;
+        }
+
+        if (r == 0 || attempt.wall < best.wall) {
+            best.wall = attempt.wall;
+            best.nodes = attempt.nodes;
+            best.steals = attempt.steals;
+            best.remote_steals = attempt.remote_steals;
+            best.sum = attempt.sum;
+        }
+        if (attempt.peak_rss > best.peak_rss) {
+            best.peak_rss = attempt.peak_rss;
+        }
+    }
+
+    *run = best;
+    return true;
+}
+
+// Print a run as one line of JSON (without a separator).
+static void run_print_json(const Run* run, FILE* file) {
+    fprintf(file, "    {\"instance\": \"%s\", \"solver\": \"%s\", \"threads\": %d, \"wall_seconds\": %.6f, "
+                  "\"nodes\": %lld, \"nodes_per_second\": %.0f, \"speedup\": %.3f, \"efficiency\": %.3f, "
+                  "\"steals\": %lld, \"remote_steals\": %lld, \"peak_rss_kb\": %ld, \"sum\": %d}",
+            run->instance, run->solver, run->threads, run->wall, run->nodes, run->nodes / run->wall,
+            run->speedup, run->speedup / run->threads, run->steals, run->remote_steals, run->peak_rss, run->sum);
+}
+
+static void runs_print_json(const Run* runs, int runs_count, const Options* options, FILE* file) {
+    fprintf(file, "{\n  \"corpus\": \"%s\",\n  \"repetitions\": %d,\n  \"cpus\": %ld,\n"
+                  "  \"parallel_options\": \"%s\",\n  \"runs\": [\n",
+            options->corpus, options->repetitions, sysconf(_SC_NPROCESSORS_ONLN), options->parallel_options);
+
+    for (int k = 0; k < runs_count; ++k) {
+        run_print_json(&runs[k], file);
+        fprintf(file, k + 1 < runs_count ? ",\n" : "\n");
+    }
+
+    fprintf(file, "  ]\n}\n");
+}
+
+/*
+ * Compare the runs with those of a baseline file written by this program, printing
+ * the change of wall time of every run found in both. Returns the number of runs
+ * slower than the baseline by more than the tolerance.
+ */
+static int runs_compare(const Run* runs, int runs_count, const char* path, double tolerance) {
+    FILE* file = fopen(path, "r");
+    if (!file) {
+        syserr("Cannot open baseline %s", path);
+    }
+
+    int regressions = 0;
+    char line[1024];
+
+    printf("\n%-12s %-13s %7s %10s %10s %8s\n", "instance", "solver", "threads", "baseline", "now", "change");
+
+    while (fgets(line, sizeof(line), file)) {
+        char instance[64], solver[64];
+        int threads;
+        double wall;
+
+        if (sscanf(line, " {\"instance\": \"%63[^\"]\", \"solver\": \"%63[^\"]\", \"threads\": %d, \"wall_seconds\": %lf",
+                   instance, solver, &threads, &wall) != 4) {
+            continue;
+        }
+
+        for (int k = 0; k < runs_count; ++k) {
+            const Run* run = &runs[k];
+
+            if (strcmp(run->instance, instance) != 0 || strcmp(run->solver, solver) != 0 || run->threads != threads) {
+                continue;
+            }
+
+            double change = run->wall / wall - 1;
+            bool regression = change > tolerance;
+            regressions += regression;
+
+            printf("%-12s %-13s %7d %10.3f %10.3f %+7.1f%%%s\n", instance, solver, threads, wall, run->wall,
+                   change * 100, regression ? "  REGRESSION" : "");
+        }
+    }
+
+    fclose(file);
+    return regressions;
+}
+
+// Parse a comma separated list of thread counts.
+static void parse_threads(Options* options, const char* list) {
+    options->threads_count = 0;
+
+    for (const char* p = list; *p;) {
+        char* end;
+        long threads = strtol(p, &end, 10);
+
+        if (end == p || threads <= 0 || options->threads_count == MAX_THREAD_COUNTS) {
+            fprintf(stderr, "Invalid thread counts: %s\n", list);
+            exit(ERROR);
+        }
+
+        options->threads[options->threads_count++] = (int)threads;
+        p = *end == ',' ? end + 1 : end;
+    }
+}
+
+// Split the extra arguments of parallel on spaces.
+static void parse_parallel_options(Options* options, const char* list) {
+    char* copy = strdup(list);
+    int count = 0;
+
+    if (!copy) {
+        exit(ERROR);
+    }
+
+    for (char* arg = strtok(copy, " "); arg; arg = strtok(NULL, " ")) {
+        if (count == MAX_SOLVER_ARGS - 3) {
+            fprintf(stderr, "Too many parallel options: %s\n", list);
+            exit(ERROR);
+        }
+        options->parallel_args[count++] = arg;
+    }
+
+    options->parallel_args[count] = NULL;
+    options->parallel_options = list;
+}
+
+// Thread counts by default: powers of two up to the number of CPUs, and that number.
+static void default_threads(Options* options) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+    options->threads_count = 0;
+    for (int threads = 1; threads < cpus && options->threads_count < MAX_THREAD_COUNTS - 1; threads *= 2) {
+        options->threads[options->threads_count++] = threads;
+    }
+    options->threads[options->threads_count++] = cpus > 1 ? (int)cpus : 1;
+}
+
+static void options_parse(Options* options, int argc, char* argv[]) {
+    static const struct option long_options[] = {
+        {"corpus", required_argument, NULL, 'c'},
+        {"threads", required_argument, NULL, 't'},
+        {"repetitions", required_argument, NULL, 'r'},
+        {"output", required_argument, NULL, 'o'},
+        {"baseline", required_argument, NULL, 'b'},
+        {"tolerance", required_argument, NULL, 'T'},
+        {"parallel-options", required_argument, NULL, 'p'},
+        {NULL, 0, NULL, 0}
+    };
+
+    options->corpus = "quick";
+    options->repetitions = 3;
+    options->output = NULL;
+    options->baseline = NULL;
+    options->tolerance = 0.1;
+    options->parallel_options = "";
+    options->parallel_args[0] = NULL;
+    default_threads(options);
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "c:t:r:o:b:T:p:", long_options, NULL)) != -1) {
+        switch (opt) {
+            case 'c':
+                if (strcmp(optarg, "quick") != 0 && strcmp(optarg, "full") != 0) {
+                    fprintf(stderr, "Unknown corpus: %s\n", optarg);
+                    exit(ERROR);
+                }
+                options->corpus = optarg;
+                break;
+            case 't':
+                parse_threads(options, optarg);
+                break;
+            case 'r':
+                options->repetitions = atoi(optarg);
+                if (options->repetitions <= 0) {
+                    fprintf(stderr, "Invalid number of repetitions: %s\n", optarg);
+                    exit(ERROR);
+                }
+                break;
+            case 'o':
+                options->output = optarg;
+                break;
+            case 'b':
+                options->baseline = optarg;
+                break;
+            case 'T':
+                options->tolerance = strtod(optarg, NULL);
+                break;
+            case 'p':
+                parse_parallel_options(options, optarg);
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [--corpus quick|full] [--threads 1,2,4] [--repetitions r] "
+                                "[--output file] [--baseline file] [--tolerance fraction] "
+                                "[--parallel-options \"options\"]\n", argv[0]);
+                exit(ERROR);
+        }
+    }
+}
+
+int main(int argc, char* argv[]) {
+    Options options;
+    options_parse(&options, argc, argv);
+
+    bool full = strcmp(options.corpus, "full") == 0;
+
+    Run runs[MAX_RUNS];
+    int runs_count = 0;
+
+    printf("%-12s %-13s %7s %10s %14s %8s %10s %10s %14s\n", "instance", "solver", "threads", "wall [s]", "nodes/s",
+           "speedup", "efficiency", "rss [kB]", "remote steals");
+
+    for (size_t i = 0; i < sizeof(corpus) / sizeof(corpus[0]); ++i) {
+        const Instance* instance = &corpus[i];
+        if (instance->full && !full) {
+            continue;
+        }
+
+        // nonrecursive first, then parallel with one thread, then the other thread counts.
+        double single_thread = 0;
+        int first = runs_count;
+
+        for (int k = -2; k < options.threads_count && runs_count < MAX_RUNS; ++k) {
+            int threads = k < 0 ? 1 : options.threads[k];
+            if (k >= 0 && threads == 1) {
+                continue;
+            }
+
+            char input[256];
+            snprintf(input, sizeof(input), "%d %d %d %d\n%s\n%s\n", threads, instance->d,
+                     instance->a_size, instance->b_size, instance->a_start, instance->b_start);
+
+            Run* run = &runs[runs_count];
+            *run = (Run){instance->name, k == -2 ? "nonrecursive" : "parallel", threads, 0, 0, 0, 0, 0, 0, 0};
+
+            bool parallel = k != -2;
+            if (!run_best(parallel ? SOLVER_PARALLEL : SOLVER_NONRECURSIVE, parallel ? options.parallel_args : NULL,
+                          input, options.repetitions, run)) {
+                return ERROR;
+            }
+
+            if (run->sum != runs[first].sum) {
+                fprintf(stderr, "%s: solvers disagree on the sum (%d and %d)\n",
+                        run->instance, runs[first].sum, run->sum);
+                return ERROR;
+            }
+
+            if (k == -1) {
+                single_thread = run->wall;
+            }
+            run->speedup = k == -2 ? 0 : single_thread / run->wall;
+
+            printf("%-12s %-13s %7d %10.3f %14.0f %8.2f %10.2f %10ld %7lld/%-6lld\n", run->instance, run->solver,
+                   run->threads, run->wall, run->nodes / run->wall, run->speedup, run->speedup / run->threads,
+                   run->peak_rss, run->remote_steals, run->steals);
+            fflush(stdout);
+
+            runs_count++;
+        }
+    }
+
+    FILE* file = options.output ? fopen(options.output, "w") : stdout;
+    if (!file) {
+        syserr("Cannot open %s", options.output);
+    }
+    if (!options.output) {
+        printf("\n");
+    }
+    runs_print_json(runs, runs_count, &options, file);
+    if (options.output) {
+        fclose(file);
+    }
+
+    int regressions = options.baseline ? runs_compare(runs, runs_count, options.baseline, options.tolerance) : 0;
+
+    return regressions > 0 ? REGRESSION : 0;
+}
@@ -0,0 +1,250 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "common/io.h"
+#include "common/sumset.h"
+#include "common/sumset_dispatch.h"
+
+
+/*
+ * Microbenchmark of the sumset kernels, one variant per instruction set.
+ * Reads an input in the solvers' format from stdin and times every kernel on
+ * pairs of sumsets sampled along random paths of the search tree. Every variant
+ * is checked against the scalar one.
+ *
+ * Usage: sumset_kernels [repetitions] < input
+ */
+
+// Constants
+enum {
+    ERROR = 1,
+    PAIRS = 4096,              // Number of sampled (a, b) pairs
+    DEFAULT_REPETITIONS = 200  // Passes over all pairs per kernel
+};
+
+// One variant of the kernels.
+typedef struct {
+    const char* name;
+    bool (*supported)(void);   // Whether the running CPU can execute the variant
+    bool (*trivial)(const Sumset* a, const Sumset* b);
+    size_t (*intersection_size)(const Sumset* a, const Sumset* b);
+    bool (*contains)(const Sumset* a, size_t i);
+    void (*add)(Sumset* result, const Sumset* a, size_t i);
+} Kernels;
+
+#define DEFINE_KERNELS(isa, is_supported, attributes)                                      \
+    static bool supported_##isa(void) {                                                    \
+        return is_supported;                                                               \
+    }                                                                                      \
+    attributes static bool trivial_##isa(const Sumset* a, const Sumset* b) {               \
+        return is_sumset_intersection_trivial(a, b);                                       \
+    }                                                                                      \
+    attributes static size_t intersection_size_##isa(const Sumset* a, const Sumset* b) {   \
+        return get_sumset_intersection_size(a, b);                                         \
+    }                                                                                      \
+    attributes static bool contains_##isa(const Sumset* a, size_t i) {                     \
+        return does_sumset_contain(a, i);                                                  \
+    }                                                                                      \
+    attributes static void add_##isa(Sumset* result, const Sumset* a, size_t i) {          \
+        sumset_add(result, a, i);                                                          \
+    }                                                                                      \
+    static const Kernels kernels_##isa = {#isa, supported_##isa, trivial_##isa,             \
+                                          intersection_size_##isa, contains_##isa, add_##isa};
+
+#if defined(__GNUC__) && !defined(__clang__)
+#define SCALAR_ATTRIBUTES __attribute__((noinline, optimize("no-tree-vectorize")))
+#else
+#define SCALAR_ATTRIBUTES __attribute__((noinline))
+#endif
+
+DEFINE_KERNELS(scalar, true, SCALAR_ATTRIBUTES)
+
+#ifdef SUMSET_DISPATCH_ENABLED
+DEFINE_KERNELS(sse42, __builtin_cpu_supports("sse4.2"), __attribute__((noinline, target("sse4.2"))))
+DEFINE_KERNELS(avx2, __builtin_cpu_supports("avx2"), __attribute__((noinline, target("avx2"))))
+DEFINE_KERNELS(avx512, __builtin_cpu_supports("avx512f"), __attribute__((noinline, target("avx512f"))))
+
+static const Kernels* const variants[] = {&kernels_scalar, &kernels_sse42, &kernels_avx2, &kernels_avx512};
+#else
+static const Kernels* const variants[] = {&kernels_scalar};
+#endif
+
+
+// Sampled pairs. Sumsets point to their parents, so they are kept in one array.
+typedef struct {
+    Sumset* nodes;
+    size_t nodes_count;
+    const Sumset* a[PAIRS];
+    const Sumset* b[PAIRS];
+    int element[PAIRS];        // Element not in b^Σ, used for contains and add
+} Samples;
+
+// Sample pairs along random root-to-leaf paths of the search tree.
+static void samples_init(Samples* samples, InputData* input_data) {
+    size_t capacity = PAIRS * 2 + 2;
+    samples->nodes = malloc(sizeof(Sumset) * capacity);
+
+    if (!samples->nodes) {
+        exit(ERROR);
+    }
+
+    samples->nodes[0] = input_data->a_start;
+    samples->nodes[1] = input_data->b_start;
+    samples->nodes_count = 2;
+
+    unsigned int seed = 1;
+    const Sumset* a = &samples->nodes[0];
+    const Sumset* b = &samples->nodes[1];
+
+    for (size_t k = 0; k < PAIRS; ++k) {
+        if (a->sum > b->sum) {
+            const Sumset* temp = a;
+            a = b;
+            b = temp;
+        }
+
+        int candidates[MAX_D + 1];
+        int count = 0;
+
+        if (is_sumset_intersection_trivial(a, b)) {
+            for (int i = a->last; i <= input_data->d; ++i) {
+                if (!does_sumset_contain(b, i)) {
+                    candidates[count++] = i;
+                }
+            }
+        }
+
+        if (count == 0) { // Leaf: restart from the root.
+            a = &samples->nodes[0];
+            b = &samples->nodes[1];
+            candidates[count++] = input_data->d;
+        }
+
+        samples->a[k] = a;
+        samples->b[k] = b;
+        samples->element[k] = candidates[rand_r(&seed) % count];
+
+        Sumset* child = &samples->nodes[samples->nodes_count++];
+        sumset_add(child, a, samples->element[k]);
+        a = child;
+    }
+}
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Check that a variant computes the same results as the scalar one.
+static bool kernels_agree(const Kernels* kernels, const Samples* samples, int d) {
+    for (size_t k = 0; k < PAIRS; ++k) {
+        const Sumset* a = samples->a[k];
+        const Sumset* b = samples->b[k];
+        Sumset expected, actual;
+
+        if (kernels->trivial(a, b) != kernels_scalar.trivial(a, b) ||
+            kernels->intersection_size(a, b) != kernels_scalar.intersection_size(a, b)) {
+            return false;
+        }
+
+        kernels_scalar.add(&expected, a, samples->element[k]);
+        kernels->add(&actual, a, samples->element[k]);
+
+        if (expected.sum != actual.sum || expected.last != actual.last) {
+            return false;
+        }
+
+        for (int i = 0; i <= expected.sum; ++i) {
+            if (kernels->contains(&actual, i) != kernels_scalar.contains(&expected, i)) {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+// Time every kernel of a variant, printing nanoseconds per call.
+static void kernels_measure(const Kernels* kernels, const Samples* samples, int repetitions) {
+    size_t calls = (size_t)PAIRS * repetitions;
+    size_t sink = 0;
+    double start;
+    Sumset result;
+
+    start = now();
+    for (int r = 0; r < repetitions; ++r) {
+        for (size_t k = 0; k < PAIRS; ++k) {
+            sink += kernels->trivial(samples->a[k], samples->b[k]);
+        }
+    }
+    double trivial = now() - start;
+
+    start = now();
+    for (int r = 0; r < repetitions; ++r) {
+        for (size_t k = 0; k < PAIRS; ++k) {
+            sink += kernels->intersection_size(samples->a[k], samples->b[k]);
+        }
+    }
+    double intersection_size = now() - start;
+
+    start = now();
+    for (int r = 0; r < repetitions; ++r) {
+        for (size_t k = 0; k < PAIRS; ++k) {
+            sink += kernels->contains(samples->b[k], samples->element[k]);
+        }
+    }
+    double contains = now() - start;
+
+    start = now();
+    for (int r = 0; r < repetitions; ++r) {
+        for (size_t k = 0; k < PAIRS; ++k) {
+            kernels->add(&result, samples->a[k], samples->element[k]);
+            sink += result.sum;
+        }
+    }
+    double add = now() - start;
+
+    printf("%-8s %12.2f %12.2f %12.2f %12.2f   (%zu)\n", kernels->name,
+           trivial / calls * 1e9, intersection_size / calls * 1e9,
+           contains / calls * 1e9, add / calls * 1e9, sink % 10);
+}
+
+int main(int argc, char* argv[]) {
+    int repetitions = argc > 1 ? atoi(argv[1]) : DEFAULT_REPETITIONS;
+
+    if (repetitions <= 0) {
+        fprintf(stderr, "Usage: %s [repetitions] < input\n", argv[0]);
+        return ERROR;
+    }
+
+    InputData input_data;
+    input_data_read(&input_data);
+
+    Samples samples;
+    samples_init(&samples, &input_data);
+
+    printf("dispatch selects: %s\n", sumset_dispatch_isa());
+    printf("%-8s %12s %12s %12s %12s   (ns per call)\n", "variant", "trivial", "inter_size", "contains", "add");
+
+    for (size_t v = 0; v < sizeof(variants) / sizeof(variants[0]); ++v) {
+        const Kernels* kernels = variants[v];
+
+        if (!kernels->supported()) {
+            printf("%-8s not supported by this CPU\n", kernels->name);
+            continue;
+        }
+
+        if (!kernels_agree(kernels, &samples, input_data.d)) {
+            fprintf(stderr, "%s: results differ from the scalar kernels\n", kernels->name);
+            return ERROR;
+        }
+
+        kernels_measure(kernels, &samples, repetitions);
+    }
+
+    free(samples.nodes);
+    return 0;
+}
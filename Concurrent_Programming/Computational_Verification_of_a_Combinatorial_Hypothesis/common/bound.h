@@ -0,0 +1,41 @@
+#pragma once
+
+#include "common/sumset.h"
+
+
+/*
+ * Upper bound for branch-and-bound pruning of the sumset search.
+ *
+ * Let (A, B) be a solution with ΣA = ΣB = S, and let X, Y be A and B with one
+ * element removed. Any common nonempty subset sum of X and Y would be a common
+ * subset sum of A and B other than 0 and S, so there is none. For sequences X, Y
+ * with ΣX <= ΣY, walking the prefix sums of X against those of Y gives |X| + 1
+ * distinct gaps in [0, max(Y) - 1] (two equal gaps give two blocks with equal
+ * sums), hence |A| <= max(B) <= d. Symmetrically, if ΣY <= ΣX then |B| <= d.
+ *
+ * A solution grown from a multiset a with n_a elements therefore satisfies
+ * S <= a.sum + (d - n_a) * d in the first case, and the same holds for b in the
+ * second. If both multisets already have more than d elements, no solution exists.
+ */
+
+// Lower bound on the number of elements of a multiset given only by its sumset.
+static inline int sumset_size_lower_bound(const Sumset* a, int d) {
+    return (a->sum + d - 1) / d;
+}
+
+// Upper bound on the sum of every solution that extends multisets with the given sums and sizes.
+static inline int solution_upper_bound(int a_sum, int a_size, int b_sum, int b_size, int d) {
+    int bound = 0;
+
+    if (a_size <= d) {
+        int a_bound = a_sum + (d - a_size) * d;
+        bound = a_bound > bound ? a_bound : bound;
+    }
+
+    if (b_size <= d) {
+        int b_bound = b_sum + (d - b_size) * d;
+        bound = b_bound > bound ? b_bound : bound;
+    }
+
+    return bound;
+}
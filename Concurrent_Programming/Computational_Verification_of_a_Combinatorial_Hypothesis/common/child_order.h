@@ -0,0 +1,189 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "common/sumset_mask.h"
+
+
+/*
+ * Order in which the children a + i of a node (a, b) are explored, a being the
+ * multiset with the smaller sum. Strong solutions found early tighten the bound
+ * of common/bound.h for the rest of the search.
+ *
+ *   descending  largest i first
+ *   ascending   smallest i first
+ *   capacity    children leaving the most room first: the most extensions for the
+ *               multiset expanded next, the smaller of a + i and b
+ *   learned     elements that closed the most solutions so far first, see ChildScores
+ *
+ * Ties are broken by the larger i.
+ */
+
+typedef enum {
+    ORDER_DESCENDING,
+    ORDER_ASCENDING,
+    ORDER_CAPACITY,
+    ORDER_LEARNED
+} ChildOrder;
+
+// Constants
+enum {
+    CHILD_SCORE_LIMIT = 1 << 20 // Scores are halved when one of them reaches this
+};
+
+// The node whose children are ordered.
+typedef struct {
+    SumsetMask a_mask;
+    SumsetMask b_mask;
+    int a_sum;
+    int b_sum;
+    int b_last;
+    int d;
+} ChildParent;
+
+// Number of solutions closed by each element, owned by a single thread.
+typedef struct {
+    uint32_t solutions[64];
+} ChildScores;
+
+// Parse the name of an order. Returns false if there is no such order.
+static inline bool child_order_parse(const char* name, ChildOrder* order) {
+    static const char* const names[] = {"descending", "ascending", "capacity", "learned"};
+
+    for (int k = 0; k < 4; ++k) {
+        if (strcmp(name, names[k]) == 0) {
+            *order = (ChildOrder)k;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// Credit the last elements of the two multisets of a solution.
+static inline void child_scores_credit(ChildScores* scores, int a_last, int b_last) {
+    scores->solutions[a_last & 63]++;
+    scores->solutions[b_last & 63]++;
+
+    if (scores->solutions[a_last & 63] >= CHILD_SCORE_LIMIT || scores->solutions[b_last & 63] >= CHILD_SCORE_LIMIT) {
+        for (int i = 0; i < 64; ++i) {
+            scores->solutions[i] /= 2;
+        }
+    }
+}
+
+// Number of extensions of the multiset expanded after the child a + i.
+static inline int child_capacity(const ChildParent* parent, int i) {
+    if (parent->a_sum + i <= parent->b_sum) {
+        return __builtin_popcountll(sumset_mask_extensions(parent->b_mask, i, parent->d));
+    }
+
+    return __builtin_popcountll(sumset_mask_extensions(sumset_mask_add(parent->a_mask, i), parent->b_last, parent->d));
+}
+
+// Key of child i, the smaller the earlier.
+static inline int64_t child_order_key(ChildOrder order, int i, const ChildParent* parent, const ChildScores* scores) {
+    switch (order) {
+        case ORDER_ASCENDING:
+            return i;
+        case ORDER_CAPACITY:
+            return -(int64_t)child_capacity(parent, i) * 64 - i;
+        case ORDER_LEARNED:
+            return -(int64_t)scores->solutions[i] * 64 - i;
+        case ORDER_DESCENDING:
+            break;
+    }
+
+    return -i;
+}
+
+/*
+ * Iterator over the children of a node. The ascending and descending orders take the
+ * children straight from the mask of extensions, the other orders sort them into a
+ * table first. Solvers compile their default order separately, so that these checks
+ * fold away there.
+ */
+typedef struct {
+    SumsetMask rest;           // Children (or positions in elements) not taken yet
+    bool highest;              // Whether the highest bit of rest is taken first
+    const int8_t* elements;    // Child at each position (or NULL)
+} ChildIterator;
+
+/*
+ * Write the elements of extensions to elements in the given order, or in the reverse
+ * order if reverse. Returns their number.
+ */
+__attribute__((noinline)) static int child_order_sort(ChildOrder order, bool reverse, SumsetMask extensions,
+                                                      const ChildParent* parent, const ChildScores* scores,
+                                                      int8_t elements[64]) {
+    // Insertion sort, there are at most d children.
+    int64_t keys[64];
+    int count = 0;
+
+    while (extensions) {
+        int i = sumset_mask_pop(&extensions);
+        int64_t key = child_order_key(order, i, parent, scores);
+        int j = count++;
+
+        if (reverse) {
+            key = -key;
+        }
+
+        while (j > 0 && keys[j - 1] > key) {
+            keys[j] = keys[j - 1];
+            elements[j] = elements[j - 1];
+            --j;
+        }
+
+        keys[j] = key;
+        elements[j] = (int8_t)i;
+    }
+
+    return count;
+}
+
+/*
+ * Start iterating over the elements of extensions, the children of parent, in the order
+ * or, if reverse, in the reverse order. Solvers pushing onto a stack iterate in reverse.
+ * buffer holds the sorted children of the orders that need it.
+ */
+static inline void child_iterator_init(ChildIterator* it, ChildOrder order, bool reverse, SumsetMask extensions,
+                                       const ChildParent* parent, const ChildScores* scores, int8_t buffer[64]) {
+    if (order == ORDER_DESCENDING || order == ORDER_ASCENDING) {
+        it->rest = extensions;
+        it->highest = (order == ORDER_ASCENDING) == reverse;
+        it->elements = NULL;
+        return;
+    }
+
+    int count = child_order_sort(order, reverse, extensions, parent, scores, buffer);
+
+    it->rest = count == 64 ? ~(SumsetMask)0 : ((SumsetMask)1 << count) - 1;
+    it->highest = false;
+    it->elements = buffer;
+}
+
+// Take the next child. Returns false if there is none left.
+static inline bool child_iterator_next(ChildIterator* it, int* i) {
+    if (!it->rest) {
+        return false;
+    }
+
+    int position;
+    if (it->highest) {
+        position = 63 - __builtin_clzll(it->rest);
+        it->rest &= ~((SumsetMask)1 << position);
+    } else {
+        position = sumset_mask_pop(&it->rest);
+    }
+
+    *i = it->elements ? it->elements[position] : position;
+    return true;
+}
+
+// Check whether some child is left.
+static inline bool child_iterator_has_next(const ChildIterator* it) {
+    return it->rest != 0;
+}
@@ -0,0 +1,434 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "common/sumset.h"
+
+
+/*
+ * Solutions kept besides the best one: the k best (--top k) or every optimal one
+ * (--all-optimal).
+ *
+ * A solution is kept as the elements of its two multisets, read from the chains of
+ * Sumsets it was built by, in increasing order. As for solution_build, a chain runs
+ * through the elements added by the search into those of the starting multiset: the
+ * root of the search is a copy of it, with its own chain. The multiset whose list is
+ * smaller (lexicographically) comes first, so that a pair reached along two paths, as
+ * (A, B) and as (B, A), is kept once. Each result is one line of text:
+ *
+ *   <sum>: <elements of A> | <elements of B>
+ *
+ * Every search thread collects its results in a ResultHeap of its own. For the k best
+ * it is a min-heap of at most k distinct results, and once it is full its smallest sum
+ * bounds the search: k distinct solutions at least that large exist, so a subtree that
+ * cannot beat it holds nothing needed. The heaps are merged when the threads finish.
+ *
+ * The optimal results are not bounded in number. A heap keeps those with the largest
+ * sum it has seen, and when it fills up they are flushed to a spill file and forgotten.
+ * The subtrees explored are those that can reach the largest sum seen, ties included.
+ * At the end, the lines of the spill file with the optimal sum are copied to the
+ * output, dropping duplicates by a 64-bit hash of the line (8 bytes per result).
+ */
+
+// Constants
+enum {
+    RESULTS_ERROR = 1,         // Exit code on an allocation failure
+    RESULTS_FLUSH = 4096       // Optimal results kept by a heap before a flush
+};
+
+typedef enum {
+    RESULTS_TOP,               // The k best
+    RESULTS_OPTIMAL            // All with the largest sum
+} ResultsMode;
+
+typedef struct {
+    int sum;
+    int a_count;               // Elements of A, then those of B
+    int count;
+    int* elements;
+} Result;
+
+typedef struct {
+    ResultsMode mode;
+    Result* results;           // A min-heap by sum (RESULTS_TOP), or the results of sum best
+    int count;
+    int capacity;              // k (RESULTS_TOP), or RESULTS_FLUSH
+    int best;                  // Largest sum seen (RESULTS_OPTIMAL)
+} ResultHeap;
+
+
+static void result_heap_init(ResultHeap* heap, ResultsMode mode, int k) {
+    heap->mode = mode;
+    heap->capacity = mode == RESULTS_TOP ? k : RESULTS_FLUSH;
+    heap->results = malloc(sizeof(Result) * heap->capacity);
+    heap->count = 0;
+    heap->best = 0;
+
+    if (!heap->results) {
+        exit(RESULTS_ERROR);
+    }
+}
+
+static void result_heap_destroy(ResultHeap* heap) {
+    for (int k = 0; k < heap->count; ++k) {
+        free(heap->results[k].elements);
+    }
+    free(heap->results);
+}
+
+/*
+ * Sum a subtree must beat to hold a result the heap takes: the smallest sum of a full
+ * heap of the k best, or one less than the largest sum seen for the optimal ones.
+ */
+static inline int result_heap_bound(const ResultHeap* heap) {
+    if (heap->mode == RESULTS_OPTIMAL) {
+        return heap->best - 1;
+    }
+
+    return heap->count == heap->capacity ? heap->results[0].sum : 0;
+}
+
+// Check whether the heap may take a solution with the given sum.
+static inline bool result_heap_may_take(const ResultHeap* heap, int sum) {
+    return sum > result_heap_bound(heap);
+}
+
+// Number of elements of the multiset of a, found by following the chain of Sumsets to the empty one.
+static int result_chain_length(const Sumset* a) {
+    int count = 0;
+
+    for (; a->prev; a = a->prev) {
+        ++count;
+    }
+
+    return count;
+}
+
+// Write the elements of a, in increasing order, to the count slots of elements.
+static void result_chain_elements(const Sumset* a, int* elements, int count) {
+    for (; a->prev; a = a->prev) {
+        elements[--count] = (int)(a->sum - a->prev->sum);
+    }
+}
+
+// Compare two lists of elements lexicographically.
+static int result_compare_elements(const int* x, int x_count, const int* y, int y_count) {
+    for (int k = 0; k < x_count && k < y_count; ++k) {
+        if (x[k] != y[k]) {
+            return x[k] < y[k] ? -1 : 1;
+        }
+    }
+
+    return (x_count > y_count) - (x_count < y_count);
+}
+
+// Build the result of the solution (a, b), with the smaller list of elements first.
+static Result result_of(const Sumset* a, const Sumset* b) {
+    int a_count = result_chain_length(a);
+    int b_count = result_chain_length(b);
+    Result result = {(int)b->sum, a_count, a_count + b_count, malloc(sizeof(int) * (a_count + b_count + 1))};
+
+    if (!result.elements) {
+        exit(RESULTS_ERROR);
+    }
+
+    result_chain_elements(a, result.elements, a_count);
+    result_chain_elements(b, result.elements + a_count, b_count);
+
+    if (result_compare_elements(result.elements + a_count, b_count, result.elements, a_count) < 0) {
+        result_chain_elements(b, result.elements, b_count);
+        result_chain_elements(a, result.elements + b_count, a_count);
+        result.a_count = b_count;
+    }
+
+    return result;
+}
+
+// Order of results: by sum, then by the elements of A and B.
+static int result_compare(const Result* x, const Result* y) {
+    if (x->sum != y->sum) {
+        return x->sum < y->sum ? -1 : 1;
+    }
+
+    int order = result_compare_elements(x->elements, x->a_count, y->elements, y->a_count);
+    if (order != 0) {
+        return order;
+    }
+
+    return result_compare_elements(x->elements + x->a_count, x->count - x->a_count,
+                                   y->elements + y->a_count, y->count - y->a_count);
+}
+
+// Print a result as one line.
+static void result_print(const Result* result, FILE* file) {
+    fprintf(file, "%d:", result->sum);
+
+    for (int k = 0; k < result->count; ++k) {
+        fprintf(file, k == result->a_count ? " | %d" : " %d", result->elements[k]);
+    }
+    if (result->a_count == result->count) {
+        fprintf(file, " |");
+    }
+
+    fprintf(file, "\n");
+}
+
+static inline void result_swap(Result* x, Result* y) {
+    Result temp = *x;
+    *x = *y;
+    *y = temp;
+}
+
+static void result_heap_sift_down(ResultHeap* heap, int k) {
+    while (true) {
+        int smallest = k;
+
+        for (int child = 2 * k + 1; child <= 2 * k + 2 && child < heap->count; ++child) {
+            if (heap->results[child].sum < heap->results[smallest].sum) {
+                smallest = child;
+            }
+        }
+
+        if (smallest == k) {
+            return;
+        }
+
+        result_swap(&heap->results[k], &heap->results[smallest]);
+        k = smallest;
+    }
+}
+
+static void result_heap_sift_up(ResultHeap* heap, int k) {
+    while (k > 0 && heap->results[(k - 1) / 2].sum > heap->results[k].sum) {
+        result_swap(&heap->results[k], &heap->results[(k - 1) / 2]);
+        k = (k - 1) / 2;
+    }
+}
+
+/*
+ * Add a result to a heap of the k best, taking over its elements. A result the heap
+ * holds already, or one below a full heap, is freed instead.
+ */
+static void result_heap_push(ResultHeap* heap, Result result) {
+    bool taken = heap->count < heap->capacity || result.sum > heap->results[0].sum;
+
+    for (int k = 0; taken && k < heap->count; ++k) {
+        taken = result_compare(&heap->results[k], &result) != 0;
+    }
+
+    if (!taken) {
+        free(result.elements);
+        return;
+    }
+
+    if (heap->count == heap->capacity) {
+        free(heap->results[0].elements);
+        heap->results[0] = result;
+        result_heap_sift_down(heap, 0);
+    } else {
+        heap->results[heap->count++] = result;
+        result_heap_sift_up(heap, heap->count - 1);
+    }
+}
+
+// Forget the results of a heap.
+static void result_heap_clear(ResultHeap* heap) {
+    for (int k = 0; k < heap->count; ++k) {
+        free(heap->results[k].elements);
+    }
+    heap->count = 0;
+}
+
+// Write the results of an optimal heap to spill and forget them.
+static void result_heap_flush(ResultHeap* heap, FILE* spill) {
+    for (int k = 0; k < heap->count; ++k) {
+        result_print(&heap->results[k], spill);
+    }
+    result_heap_clear(heap);
+}
+
+/*
+ * Add the solution (a, b), whose sum the heap may take (see result_heap_may_take).
+ * Returns true if an optimal heap is full then, and must be flushed before the next one.
+ */
+static bool result_heap_add(ResultHeap* heap, const Sumset* a, const Sumset* b) {
+    Result result = result_of(a, b);
+
+    if (heap->mode == RESULTS_TOP) {
+        result_heap_push(heap, result);
+        return false;
+    }
+
+    // A larger sum makes the results kept so far suboptimal.
+    if (result.sum > heap->best) {
+        result_heap_clear(heap);
+        heap->best = result.sum;
+    }
+
+    heap->results[heap->count++] = result;
+    return heap->count == heap->capacity;
+}
+
+/*
+ * Move the results of from into into, a heap of the same mode. Optimal results go to
+ * spill, unless their sum is smaller than the other heap's; then they are dropped.
+ */
+static void result_heap_merge(ResultHeap* into, ResultHeap* from, FILE* spill) {
+    if (into->mode == RESULTS_TOP) {
+        for (int k = 0; k < from->count; ++k) {
+            result_heap_push(into, from->results[k]);
+        }
+        from->count = 0;
+        return;
+    }
+
+    if (from->best > into->best) {
+        result_heap_clear(into);
+        into->best = from->best;
+    }
+
+    if (from->best == into->best) {
+        result_heap_flush(into, spill);
+        result_heap_flush(from, spill);
+    } else {
+        result_heap_clear(from);
+    }
+}
+
+// Open an anonymous spill file next to path. Returns NULL on an I/O error.
+static FILE* results_spill_open(const char* path) {
+    size_t length = strlen(path);
+    char* spill_path = malloc(length + 7);
+
+    if (!spill_path) {
+        exit(RESULTS_ERROR);
+    }
+
+    memcpy(spill_path, path, length);
+    memcpy(spill_path + length, ".spill", 7);
+
+    FILE* spill = fopen(spill_path, "w+");
+    if (spill) {
+        unlink(spill_path);
+    }
+
+    free(spill_path);
+    return spill;
+}
+
+static int result_compare_descending(const void* x, const void* y) {
+    return result_compare((const Result*)y, (const Result*)x);
+}
+
+// Hash of a line, never 0.
+static uint64_t results_line_hash(const char* line, size_t length) {
+    uint64_t hash = 14695981039346656037ULL; // FNV-1a
+
+    for (size_t k = 0; k < length; ++k) {
+        hash = (hash ^ (uint8_t)line[k]) * 1099511628211ULL;
+    }
+
+    return hash ? hash : 1;
+}
+
+// Add a hash to an open addressing set. Returns false if it is there already.
+static bool results_hash_insert(uint64_t** set, size_t* capacity, size_t* count, uint64_t hash) {
+    if (2 * (*count + 1) > *capacity) {
+        size_t old_capacity = *capacity;
+        uint64_t* old = *set;
+
+        *capacity = old_capacity ? old_capacity * 2 : 1024;
+        *set = calloc(*capacity, sizeof(uint64_t));
+        *count = 0;
+
+        if (!*set) {
+            exit(RESULTS_ERROR);
+        }
+
+        for (size_t k = 0; k < old_capacity; ++k) {
+            if (old[k]) {
+                results_hash_insert(set, capacity, count, old[k]);
+            }
+        }
+        free(old);
+    }
+
+    size_t slot = hash & (*capacity - 1);
+    while ((*set)[slot]) {
+        if ((*set)[slot] == hash) {
+            return false;
+        }
+        slot = (slot + 1) & (*capacity - 1);
+    }
+
+    (*set)[slot] = hash;
+    ++*count;
+    return true;
+}
+
+// Copy the distinct lines of spill with the given sum to file. Returns their number.
+static size_t results_copy_optimal(FILE* spill, int sum, FILE* file) {
+    uint64_t* set = NULL;
+    size_t capacity = 0, count = 0;
+    char* line = NULL;
+    size_t line_capacity = 0;
+    ssize_t length;
+
+    rewind(spill);
+    while ((length = getline(&line, &line_capacity, spill)) > 0) {
+        if (atoi(line) == sum && results_hash_insert(&set, &capacity, &count, results_line_hash(line, length))) {
+            fwrite(line, 1, length, file);
+        }
+    }
+
+    free(line);
+    free(set);
+    return count;
+}
+
+/*
+ * Write the results of a merged heap to path, the largest sums first, with those of the
+ * spill file for the optimal ones. Like a snapshot, the file is written to path.tmp first
+ * and renamed. Sets written to the number of results. Returns false on an I/O error.
+ */
+static bool results_write(ResultHeap* heap, FILE* spill, const char* path, size_t* written) {
+    size_t length = strlen(path);
+    char* temp_path = malloc(length + 5);
+
+    if (!temp_path) {
+        exit(RESULTS_ERROR);
+    }
+
+    memcpy(temp_path, path, length);
+    memcpy(temp_path + length, ".tmp", 5);
+
+    FILE* file = fopen(temp_path, "w");
+    if (!file) {
+        free(temp_path);
+        return false;
+    }
+
+    if (heap->mode == RESULTS_TOP) {
+        qsort(heap->results, heap->count, sizeof(Result), result_compare_descending);
+
+        for (int k = 0; k < heap->count; ++k) {
+            result_print(&heap->results[k], file);
+        }
+        *written = heap->count;
+    } else {
+        result_heap_flush(heap, spill);
+        *written = heap->best > 0 && fflush(spill) == 0 ? results_copy_optimal(spill, heap->best, file) : 0;
+    }
+
+    bool ok = (!spill || !ferror(spill)) && fflush(file) == 0 && fsync(fileno(file)) == 0;
+    ok = fclose(file) == 0 && ok;
+    ok = ok && rename(temp_path, path) == 0;
+
+    free(temp_path);
+    return ok;
+}
@@ -0,0 +1,314 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "common/io.h"
+#include "common/sumset.h"
+
+
+/*
+ * Snapshots of the search frontier, for checkpointing and resuming long runs.
+ *
+ * A snapshot holds the multisets of every unexplored frame, the best solution found
+ * so far and a fingerprint of the input. Multisets are stored as a tree, like the
+ * Ref_sumset nodes they come from: node k > 1 is node parent extended by element,
+ * nodes 0 and 1 are a_start and b_start of the input. Text format:
+ *
+ *   sumset-snapshot 1
+ *   input <d> <fingerprint>
+ *   nodes <n>       followed by n - 2 lines "<parent> <element>", parents first
+ *   frames <m>      followed by m lines "<a> <b>"
+ *   best <sum> <a> <b>
+ *
+ * The best solution is given by its two nodes, both -1 if there is none.
+ */
+
+// Constants
+enum {
+    SNAPSHOT_ROOT_A = 0,
+    SNAPSHOT_ROOT_B = 1,
+    SNAPSHOT_VERSION = 1
+};
+
+typedef struct {
+    int parent;                // Id of the parent node
+    int element;               // Element added to the parent
+} SnapshotNode;
+
+typedef struct {
+    int a;
+    int b;
+} SnapshotFrame;
+
+typedef struct {
+    int d;
+    uint64_t fingerprint;      // Hash of the input, see snapshot_fingerprint
+    SnapshotNode* nodes;       // Nodes by id, the first two are the roots
+    size_t nodes_count;
+    size_t nodes_capacity;
+    SnapshotFrame* frames;
+    size_t frames_count;
+    size_t frames_capacity;
+    int best_sum;
+    int best_a;                // Node ids of the best solution (or -1)
+    int best_b;
+    const void** keys;         // Open addressing table from node addresses to ids
+    int* ids;
+    size_t keys_capacity;
+} Snapshot;
+
+
+// Hash of the input: d and the subset sums of both starting multisets.
+static uint64_t snapshot_fingerprint(const InputData* input_data) {
+    uint64_t hash = 14695981039346656037ULL; // FNV-1a
+    const Sumset* roots[2] = {&input_data->a_start, &input_data->b_start};
+
+    hash = (hash ^ (uint64_t)input_data->d) * 1099511628211ULL;
+
+    for (int k = 0; k < 2; ++k) {
+        hash = (hash ^ (uint64_t)roots[k]->sum) * 1099511628211ULL;
+
+        for (int i = 0; i <= roots[k]->sum; ++i) {
+            hash = (hash ^ (uint64_t)does_sumset_contain(roots[k], i)) * 1099511628211ULL;
+        }
+    }
+
+    return hash;
+}
+
+static void* snapshot_grow(void* array, size_t* capacity, size_t element_size) {
+    *capacity = *capacity ? *capacity * 2 : 64;
+    array = realloc(array, element_size * *capacity);
+
+    if (!array) {
+        exit(1);
+    }
+
+    return array;
+}
+
+// Initialize an empty snapshot of the search of the given input.
+static void snapshot_init(Snapshot* snapshot, const InputData* input_data) {
+    memset(snapshot, 0, sizeof(Snapshot));
+
+    snapshot->d = input_data->d;
+    snapshot->fingerprint = snapshot_fingerprint(input_data);
+    snapshot->best_a = -1;
+    snapshot->best_b = -1;
+
+    snapshot->nodes = snapshot_grow(NULL, &snapshot->nodes_capacity, sizeof(SnapshotNode));
+    snapshot->nodes[SNAPSHOT_ROOT_A] = (SnapshotNode){-1, 0};
+    snapshot->nodes[SNAPSHOT_ROOT_B] = (SnapshotNode){-1, 0};
+    snapshot->nodes_count = 2;
+}
+
+static void snapshot_destroy(Snapshot* snapshot) {
+    free(snapshot->nodes);
+    free(snapshot->frames);
+    free(snapshot->keys);
+    free(snapshot->ids);
+}
+
+static inline size_t snapshot_slot(const Snapshot* snapshot, const void* key) {
+    uint64_t hash = (uint64_t)(uintptr_t)key * 0x9E3779B97F4A7C15ULL;
+    return (size_t)(hash >> 32) & (snapshot->keys_capacity - 1);
+}
+
+// Id of the node added with the given address, or -1.
+static int snapshot_find(const Snapshot* snapshot, const void* key) {
+    if (snapshot->keys_capacity == 0) {
+        return -1;
+    }
+
+    for (size_t slot = snapshot_slot(snapshot, key); snapshot->keys[slot];
+         slot = (slot + 1) & (snapshot->keys_capacity - 1)) {
+        if (snapshot->keys[slot] == key) {
+            return snapshot->ids[slot];
+        }
+    }
+
+    return -1;
+}
+
+static void snapshot_index(Snapshot* snapshot, const void* key, int id) {
+    if (2 * (snapshot->nodes_count + 1) > snapshot->keys_capacity) {
+        const void** keys = snapshot->keys;
+        int* ids = snapshot->ids;
+        size_t capacity = snapshot->keys_capacity;
+
+        snapshot->keys_capacity = capacity ? capacity * 2 : 1024;
+        snapshot->keys = calloc(snapshot->keys_capacity, sizeof(const void*));
+        snapshot->ids = malloc(sizeof(int) * snapshot->keys_capacity);
+
+        if (!snapshot->keys || !snapshot->ids) {
+            exit(1);
+        }
+
+        for (size_t slot = 0; slot < capacity; ++slot) {
+            if (keys[slot]) {
+                snapshot_index(snapshot, keys[slot], ids[slot]);
+            }
+        }
+
+        free(keys);
+        free(ids);
+    }
+
+    size_t slot = snapshot_slot(snapshot, key);
+    while (snapshot->keys[slot]) {
+        slot = (slot + 1) & (snapshot->keys_capacity - 1);
+    }
+
+    snapshot->keys[slot] = key;
+    snapshot->ids[slot] = id;
+}
+
+/*
+ * Add the node parent + element, remembering it under the address key. Returns its id.
+ * key may be NULL for a node that is not looked up again.
+ */
+static int snapshot_add_node(Snapshot* snapshot, const void* key, int parent, int element) {
+    if (snapshot->nodes_count == snapshot->nodes_capacity) {
+        snapshot->nodes = snapshot_grow(snapshot->nodes, &snapshot->nodes_capacity, sizeof(SnapshotNode));
+    }
+
+    int id = (int)snapshot->nodes_count;
+    if (key) {
+        snapshot_index(snapshot, key, id);
+    }
+    snapshot->nodes[snapshot->nodes_count++] = (SnapshotNode){parent, element};
+
+    return id;
+}
+
+static void snapshot_add_frame(Snapshot* snapshot, int a, int b) {
+    if (snapshot->frames_count == snapshot->frames_capacity) {
+        snapshot->frames = snapshot_grow(snapshot->frames, &snapshot->frames_capacity, sizeof(SnapshotFrame));
+    }
+
+    snapshot->frames[snapshot->frames_count++] = (SnapshotFrame){a, b};
+}
+
+// Print the snapshot in the text format to file.
+static void snapshot_print(const Snapshot* snapshot, FILE* file) {
+    fprintf(file, "sumset-snapshot %d\n", SNAPSHOT_VERSION);
+    fprintf(file, "input %d %llu\n", snapshot->d, (unsigned long long)snapshot->fingerprint);
+
+    fprintf(file, "nodes %zu\n", snapshot->nodes_count);
+    for (size_t k = 2; k < snapshot->nodes_count; ++k) {
+        fprintf(file, "%d %d\n", snapshot->nodes[k].parent, snapshot->nodes[k].element);
+    }
+
+    fprintf(file, "frames %zu\n", snapshot->frames_count);
+    for (size_t k = 0; k < snapshot->frames_count; ++k) {
+        fprintf(file, "%d %d\n", snapshot->frames[k].a, snapshot->frames[k].b);
+    }
+
+    fprintf(file, "best %d %d %d\n", snapshot->best_sum, snapshot->best_a, snapshot->best_b);
+}
+
+/*
+ * Write the snapshot to path. The snapshot is written to path.tmp first and renamed,
+ * so path always holds a complete snapshot. Returns false on an I/O error.
+ */
+static bool snapshot_write(const Snapshot* snapshot, const char* path) {
+    size_t length = strlen(path);
+    char* temp_path = malloc(length + 5);
+
+    if (!temp_path) {
+        exit(1);
+    }
+
+    memcpy(temp_path, path, length);
+    memcpy(temp_path + length, ".tmp", 5);
+
+    FILE* file = fopen(temp_path, "w");
+    if (!file) {
+        free(temp_path);
+        return false;
+    }
+
+    snapshot_print(snapshot, file);
+
+    bool ok = fflush(file) == 0 && fsync(fileno(file)) == 0;
+    ok = fclose(file) == 0 && ok;
+    ok = ok && rename(temp_path, path) == 0;
+
+    free(temp_path);
+    return ok;
+}
+
+/*
+ * Scan a snapshot of the search of the given input from file. name is used in messages.
+ * Prints the reason and returns false if the snapshot is malformed or belongs to another input.
+ */
+static bool snapshot_scan(Snapshot* snapshot, FILE* file, const char* name, const InputData* input_data) {
+    snapshot_init(snapshot, input_data);
+
+    int version, d;
+    unsigned long long fingerprint;
+    size_t nodes_count, frames_count;
+    bool ok = fscanf(file, " sumset-snapshot %d input %d %llu", &version, &d, &fingerprint) == 3 &&
+              version == SNAPSHOT_VERSION;
+
+    if (ok && (d != input_data->d || fingerprint != snapshot->fingerprint)) {
+        fprintf(stderr, "Snapshot %s belongs to a different input\n", name);
+        return false;
+    }
+
+    ok = ok && fscanf(file, " nodes %zu", &nodes_count) == 1 && nodes_count >= 2;
+    for (size_t k = 2; ok && k < nodes_count; ++k) {
+        int parent, element;
+        ok = fscanf(file, "%d %d", &parent, &element) == 2 &&
+             parent >= 0 && parent < (int)k && element >= 1 && element <= d;
+
+        if (ok) {
+            if (snapshot->nodes_count == snapshot->nodes_capacity) {
+                snapshot->nodes = snapshot_grow(snapshot->nodes, &snapshot->nodes_capacity, sizeof(SnapshotNode));
+            }
+            snapshot->nodes[snapshot->nodes_count++] = (SnapshotNode){parent, element};
+        }
+    }
+
+    ok = ok && fscanf(file, " frames %zu", &frames_count) == 1;
+    for (size_t k = 0; ok && k < frames_count; ++k) {
+        int a, b;
+        ok = fscanf(file, "%d %d", &a, &b) == 2 &&
+             a >= 0 && a < (int)nodes_count && b >= 0 && b < (int)nodes_count;
+
+        if (ok) {
+            snapshot_add_frame(snapshot, a, b);
+        }
+    }
+
+    ok = ok && fscanf(file, " best %d %d %d", &snapshot->best_sum, &snapshot->best_a, &snapshot->best_b) == 3 &&
+         snapshot->best_a >= -1 && snapshot->best_a < (int)nodes_count &&
+         snapshot->best_b >= -1 && snapshot->best_b < (int)nodes_count &&
+         (snapshot->best_a >= 0) == (snapshot->best_b >= 0);
+
+    if (!ok) {
+        fprintf(stderr, "Malformed snapshot %s\n", name);
+    }
+
+    return ok;
+}
+
+// Read a snapshot of the search of the given input from path, see snapshot_scan.
+static bool snapshot_read(Snapshot* snapshot, const char* path, const InputData* input_data) {
+    FILE* file = fopen(path, "r");
+    if (!file) {
+        snapshot_init(snapshot, input_data);
+        fprintf(stderr, "Cannot open snapshot %s\n", path);
+        return false;
+    }
+
+    bool ok = snapshot_scan(snapshot, file, path, input_data);
+    fclose(file);
+
+    return ok;
+}
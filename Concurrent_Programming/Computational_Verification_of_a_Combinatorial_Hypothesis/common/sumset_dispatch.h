@@ -0,0 +1,52 @@
+#pragma once
+
+#include "common/sumset.h"
+
+
+/*
+ * Runtime CPU dispatch for the sumset kernels.
+ *
+ * The kernels in common/sumset.h are static inline loops over the bitset words.
+ * Functions marked SUMSET_DISPATCH are compiled once per instruction set below,
+ * with the kernels inlined and vectorized for it, and the dynamic loader picks
+ * the best variant for the running CPU once, at startup (GNU ifunc). This lets a
+ * build without -march=native (cmake -DPORTABLE=ON) run well on every machine.
+ */
+
+// ThreadSanitizer crashes in ifunc resolvers, which run before it is initialized.
+#if defined(__SANITIZE_THREAD__)
+#define SUMSET_DISPATCH_SANITIZED 1
+#elif defined(__has_feature)
+#if __has_feature(thread_sanitizer)
+#define SUMSET_DISPATCH_SANITIZED 1
+#endif
+#endif
+
+#if defined(__x86_64__) && defined(__linux__) && defined(__has_attribute) && !defined(SUMSET_DISPATCH_SANITIZED)
+#if __has_attribute(target_clones)
+#define SUMSET_DISPATCH_ENABLED 1
+#endif
+#endif
+
+#ifdef SUMSET_DISPATCH_ENABLED
+#define SUMSET_DISPATCH __attribute__((target_clones("avx512f", "avx2", "sse4.2", "default")))
+#else
+#define SUMSET_DISPATCH
+#endif
+
+// Name of the kernel variant chosen for this CPU, in the order the loader tries them.
+static inline const char* sumset_dispatch_isa(void) {
+#ifdef SUMSET_DISPATCH_ENABLED
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) {
+        return "avx512f";
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        return "avx2";
+    }
+    if (__builtin_cpu_supports("sse4.2")) {
+        return "sse4.2";
+    }
+#endif
+    return "default";
+}
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "common/io.h"
+#include "common/sumset.h"
+
+
+/*
+ * Fixed-width sumsets for small d.
+ *
+ * A pair (a, b) is expanded only while s(a) ∩ s(b) = {0}, and then the multiset a with
+ * the smaller sum has at most d - 1 elements (the prefix sum argument of common/bound.h
+ * needs nothing else). So every multiset met by the search other than the starting
+ * ones sums to at most d^2, and its subset sums fit in 64, 128, 256 or 512 bits for d up
+ * to 7, 11, 15 or 22. A SumsetFixed keeps them in its first `words` words.
+ *
+ * The kernels take the number of words as an argument. Solvers call them from bodies
+ * instantiated once per width with a constant, so that the loops unroll fully and
+ * nothing is derived from the sums at run time. Inputs that need more than 512 bits
+ * take the generic path, on the Sumset kernels of common/sumset.h.
+ */
+
+// Constants
+enum {
+    SUMSET_FIXED_MAX_WORDS = 8 // Words of the widest specialization
+};
+
+typedef struct {
+    uint64_t words[SUMSET_FIXED_MAX_WORDS]; // Subset sums, sum s is bit s % 64 of word s / 64
+    int sum;                   // Sum of the multiset
+    int last;                  // Last element added
+} SumsetFixed;
+
+/*
+ * Number of words of the narrowest width that fits every multiset of the search of the
+ * input, 1, 2, 4 or 8. Returns 0 if none does.
+ */
+static inline int sumset_fixed_words(const InputData* input_data) {
+    int largest = input_data->d * input_data->d;
+
+    if (input_data->a_start.sum > largest) {
+        largest = input_data->a_start.sum;
+    }
+    if (input_data->b_start.sum > largest) {
+        largest = input_data->b_start.sum;
+    }
+
+    for (int words = 1; words <= SUMSET_FIXED_MAX_WORDS; words *= 2) {
+        if (largest < 64 * words) {
+            return words;
+        }
+    }
+
+    return 0;
+}
+
+// Copy the subset sums of a sumset that fits in the given width.
+static inline void sumset_fixed_of(SumsetFixed* result, const Sumset* a, int words) {
+    for (int k = 0; k < words; ++k) {
+        result->words[k] = 0;
+    }
+
+    for (int s = 0; s <= a->sum && s < 64 * words; ++s) {
+        if (does_sumset_contain(a, s)) {
+            result->words[s / 64] |= (uint64_t)1 << (s % 64);
+        }
+    }
+
+    result->sum = a->sum;
+    result->last = a->last;
+}
+
+// Set result to a + i, for 0 < i < 64.
+static inline void sumset_fixed_add(SumsetFixed* result, const SumsetFixed* a, int i, int words) {
+    uint64_t carry = 0;
+
+    for (int k = 0; k < words; ++k) {
+        result->words[k] = a->words[k] | (a->words[k] << i) | carry;
+        carry = a->words[k] >> (64 - i);
+    }
+
+    result->sum = a->sum + i;
+    result->last = i;
+}
+
+// Check whether s(a) ∩ s(b) = {0}.
+static inline bool sumset_fixed_is_intersection_trivial(const SumsetFixed* a, const SumsetFixed* b, int words) {
+    uint64_t common = (a->words[0] & b->words[0]) ^ 1;
+
+    for (int k = 1; k < words; ++k) {
+        common |= a->words[k] & b->words[k];
+    }
+
+    return common == 0;
+}
+
+// Size of s(a) ∩ s(b).
+static inline int sumset_fixed_intersection_size(const SumsetFixed* a, const SumsetFixed* b, int words) {
+    int size = 0;
+
+    for (int k = 0; k < words; ++k) {
+        size += __builtin_popcountll(a->words[k] & b->words[k]);
+    }
+
+    return size;
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "common/sumset.h"
+
+
+/*
+ * Word-parallel enumeration of the children of a node.
+ *
+ * Every element is at most d <= MAX_D < 64, so all candidate extensions of a node,
+ * and all sums checked by them, lie in the first 64 subset sums. Each node keeps
+ * these sums as one word, updated together with its sumset: the sums of a + i are
+ * the sums of a, shifted by i or not. The valid extensions of a are then the bits of
+ * ~mask(b) in [a.last, d], enumerated with count-trailing-zeros.
+ */
+
+_Static_assert(MAX_D < 64, "Subset sums up to MAX_D must fit in one mask word");
+
+typedef uint64_t SumsetMask;
+
+// Mask of the subset sums below 64 of a sumset.
+static inline SumsetMask sumset_mask_of(const Sumset* a) {
+    SumsetMask mask = 0;
+
+    for (int i = 0; i < 64; ++i) {
+        if (does_sumset_contain(a, i)) {
+            mask |= (SumsetMask)1 << i;
+        }
+    }
+
+    return mask;
+}
+
+// Mask of the sumset of a + i.
+static inline SumsetMask sumset_mask_add(SumsetMask a, int i) {
+    return a | (a << i);
+}
+
+// Elements in [from, d] that are not in the sumset with the given mask.
+static inline SumsetMask sumset_mask_extensions(SumsetMask b, int from, int d) {
+    if (from > d) {
+        return 0;
+    }
+
+    SumsetMask range = (~(SumsetMask)0 << from) & (~(SumsetMask)0 >> (63 - d));
+    return ~b & range;
+}
+
+// Cheap necessary condition for s(a) ∩ s(b) = {0}: the low sums must not intersect.
+static inline bool sumset_mask_may_be_trivial(SumsetMask a, SumsetMask b) {
+    return (a & b) == 1;
+}
+
+// Take the smallest element of a non-empty mask, removing it from the mask.
+static inline int sumset_mask_pop(SumsetMask* mask) {
+    int i = __builtin_ctzll(*mask);
+    *mask &= *mask - 1;
+    return i;
+}
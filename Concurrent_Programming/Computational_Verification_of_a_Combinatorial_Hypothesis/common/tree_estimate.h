@@ -0,0 +1,144 @@
+#pragma once
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "common/io.h"
+#include "common/sumset.h"
+#include "common/bound.h"
+#include "common/sumset_mask.h"
+
+
+/*
+ * Knuth's estimate of the size of the search tree.
+ *
+ * A walk goes from the roots to a leaf, taking a uniformly random child at each node.
+ * If the nodes on its path have c_1, c_2, ... children, then 1 + c_1 + c_1 c_2 + ...
+ * is an unbiased estimate of the number of nodes of the tree. Walks expand nodes by
+ * the rule of the solvers: a node has children only if the subset sums of its two
+ * multisets meet in 0 alone, a child adds an element to the multiset with the smaller
+ * sum, and children that cannot beat a given best sum are pruned (see common/bound.h).
+ *
+ * The solvers improve their best sum as they go, so a walk pruned with the final best
+ * sum estimates the nodes left once it is found. Single estimates vary wildly, the
+ * mean of many is reported with its standard error.
+ */
+
+typedef struct {
+    size_t walks;              // Number of walks
+    double sum;                // Sum of their estimates
+    double sum_squares;        // Sum of the squares of their estimates
+    int best_sum;              // Best sum the walks prune with
+    bool prune;                // Whether they prune at all
+} TreeEstimate;
+
+// A multiset on the path of a walk.
+typedef struct {
+    Sumset sumset;
+    SumsetMask mask;
+    int size;                  // Lower bound on the number of elements, see common/bound.h
+} TreeWalkNode;
+
+// Start an estimate of the tree pruned with best_sum, or not pruned at all unless prune.
+static inline void tree_estimate_init(TreeEstimate* estimate, int best_sum, bool prune) {
+    estimate->walks = 0;
+    estimate->sum = 0;
+    estimate->sum_squares = 0;
+    estimate->best_sum = best_sum;
+    estimate->prune = prune;
+}
+
+/*
+ * Walk from the pair (a_start, b_start) to a leaf of its subtree, adding the estimate of
+ * the walk. The sizes are the numbers of elements of the multisets (or lower bounds).
+ */
+static void tree_estimate_walk_from(TreeEstimate* estimate, const Sumset* a_start, int a_size,
+                                    const Sumset* b_start, int b_size, int d, unsigned int* seed) {
+    TreeWalkNode nodes[3];
+    TreeWalkNode* a = &nodes[0];
+    TreeWalkNode* b = &nodes[1];
+    TreeWalkNode* spare = &nodes[2];
+
+    a->sumset = *a_start;
+    a->mask = sumset_mask_of(a_start);
+    a->size = a_size;
+    b->sumset = *b_start;
+    b->mask = sumset_mask_of(b_start);
+    b->size = b_size;
+
+    double weight = 1; // Product of the numbers of children on the path so far
+    double nodes_estimate = 0;
+
+    for (;;) {
+        if (a->sumset.sum > b->sumset.sum) {
+            TreeWalkNode* temp = a;
+            a = b;
+            b = temp;
+        }
+
+        nodes_estimate += weight;
+
+        if (!sumset_mask_may_be_trivial(a->mask, b->mask) || !is_sumset_intersection_trivial(&a->sumset, &b->sumset)) {
+            break;
+        }
+
+        SumsetMask extensions = sumset_mask_extensions(b->mask, a->sumset.last, d);
+        int children[64];
+        int count = 0;
+
+        while (extensions) {
+            int i = sumset_mask_pop(&extensions);
+
+            if (!estimate->prune ||
+                solution_upper_bound(a->sumset.sum + i, a->size + 1, b->sumset.sum, b->size, d) > estimate->best_sum) {
+                children[count++] = i;
+            }
+        }
+
+        if (count == 0) {
+            break;
+        }
+
+        int i = children[rand_r(seed) % count];
+        weight *= count;
+
+        sumset_add(&spare->sumset, &a->sumset, i);
+        spare->mask = sumset_mask_add(a->mask, i);
+        spare->size = a->size + 1;
+
+        TreeWalkNode* temp = a;
+        a = spare;
+        spare = temp;
+    }
+
+    estimate->walks++;
+    estimate->sum += nodes_estimate;
+    estimate->sum_squares += nodes_estimate * nodes_estimate;
+}
+
+// Walk from the roots of the input to a leaf, adding the estimate of the walk.
+static inline void tree_estimate_walk(TreeEstimate* estimate, const InputData* input_data, unsigned int* seed) {
+    int d = input_data->d;
+
+    tree_estimate_walk_from(estimate, &input_data->a_start, sumset_size_lower_bound(&input_data->a_start, d),
+                            &input_data->b_start, sumset_size_lower_bound(&input_data->b_start, d), d, seed);
+}
+
+// Estimated number of nodes of the tree (0 before the first walk).
+static inline double tree_estimate_nodes(const TreeEstimate* estimate) {
+    return estimate->walks ? estimate->sum / estimate->walks : 0;
+}
+
+// Standard error of tree_estimate_nodes.
+static inline double tree_estimate_error(const TreeEstimate* estimate) {
+    if (estimate->walks < 2) {
+        return INFINITY;
+    }
+
+    double n = (double)estimate->walks;
+    double mean = estimate->sum / n;
+    double variance = (estimate->sum_squares - n * mean * mean) / (n - 1);
+
+    return sqrt(fmax(variance, 0) / n);
+}
@@ -1,12 +1,26 @@
 #include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <getopt.h>
+#include <math.h>
+#include <time.h>
+#include <sys/mman.h>
 #include "common/io.h"
 #include "common/sumset.h"
+#include "common/bound.h"
+#include "common/sumset_dispatch.h"
+#include "common/sumset_mask.h"
+#include "common/sumset_fixed.h"
+#include "common/child_order.h"
+#include "common/snapshot.h"
 
 
 // Constants
 enum {
     ERROR = 1,
-    POOL_BLOCK_SIZE = 1000 // Number of Ref_sumset structures per block
+    POOL_BLOCK_SIZE = 1000, // Number of Ref_sumset structures per block
+    CLOCK_PERIOD = 4096,    // Frames between two checks of the snapshot timer and the limits
+    STACK_CHUNK_FRAMES = 4095 // Frames per stack chunk, which then takes 64 KiB
 };
 
 
@@ -16,8 +30,13 @@ enum {
 
 // Structure for Ref_sumset
 typedef struct Ref_sumset {
-    Sumset this_sumset;       // Pointer to the sumset
+    union {
+        Sumset this_sumset;    // Pointer to the sumset
+        SumsetFixed fixed;     // Subset sums in the search's width, see common/sumset_fixed.h
+    };
+    SumsetMask mask;           // Subset sums below 64, see common/sumset_mask.h (the generic search only)
     int ref_count;             // Reference count for memory management
+    int size;                  // Number of elements of the multiset (lower bound for the roots)
     struct Ref_sumset* parent; // Pointer to the parent sumset
     struct Ref_sumset* next;   // Pointer to the next free node (for pooling)
 } Ref_sumset;
@@ -34,6 +53,57 @@ typedef struct {
     Ref_sumset* b;
 } StackFrame;
 
+// Fixed-size chunk of the stack.
+typedef struct StackChunk {
+    struct StackChunk* below;  // Chunk under this one (or NULL)
+    StackFrame frames[STACK_CHUNK_FRAMES];
+} StackChunk;
+
+/*
+ * Stack of frames still to be expanded, as a list of chunks. Frames never move: a full
+ * chunk gets a new chunk on top of it. One emptied chunk is kept as a spare, so that
+ * the stack does not map and unmap a chunk whenever its size crosses a chunk boundary;
+ * other emptied chunks are returned to the system.
+ */
+typedef struct {
+    StackFrame* top;           // Next free slot of the top chunk
+    StackChunk* chunk;         // Top chunk
+    StackChunk* spare;         // Empty chunk to reuse (or NULL)
+    size_t chunks;             // Number of chunks in use
+    size_t max_chunks;         // Maximal value of chunks
+} Stack;
+
+// Command line options.
+typedef struct {
+    bool prune;                // Cut subtrees that cannot beat the best solution
+    bool stats;                // Print search statistics to stderr
+    const char* checkpoint;    // Snapshot file (or NULL)
+    double interval;           // Seconds between snapshots
+    const char* resume;        // Snapshot to resume from (or NULL)
+    ChildOrder order;          // Order of the children, see common/child_order.h
+    double time_limit;         // Seconds after which the search stops (0 for no limit)
+    size_t node_limit;         // Nodes after which the search stops (0 for no limit)
+} Options;
+
+// Search statistics.
+typedef struct {
+    size_t nodes;              // Number of expanded (a, b) pairs
+    size_t pruned;             // Number of subtrees cut by the bound
+    size_t snapshots;          // Number of snapshots written
+} Stats;
+
+// State of the search needed to take snapshots.
+typedef struct {
+    Ref_sumset* roots[2];      // Nodes of a_start and b_start
+    StackFrame best;           // Nodes of the best solution, kept alive for snapshots
+    double next_snapshot;      // Time of the next snapshot
+    ChildScores scores;        // Solutions closed by each element, for the learned order
+    double start_time;
+    double deadline;           // Time at which the search stops (or INFINITY)
+    const char* stop_reason;   // Limit that stopped the search (or NULL)
+    int words;                 // Width of the nodes' sumsets, see common/sumset_fixed.h (0 for the generic one)
+} Search;
+
 /*
  * Functions for memory pool management.
  */
@@ -114,32 +184,348 @@ static inline void sumset_release(RefSumsetPool* pool, Ref_sumset* sumset) {
     }
 }
 
+// Create the node a + i, holding a reference to a, with a sumset of the given width (0 for the generic one).
+static inline Ref_sumset* sumset_extend(RefSumsetPool* pool, Ref_sumset* a, int i, int words) {
+    Ref_sumset* new_node = pool_allocate(pool);
+
+    if (words) {
+        sumset_fixed_add(&new_node->fixed, &a->fixed, i, words);
+    } else {
+        sumset_add(&new_node->this_sumset, &a->this_sumset, i);
+        new_node->mask = sumset_mask_add(a->mask, i);
+    }
+
+    new_node->parent = a;
+    new_node->ref_count = 1;
+    new_node->size = a->size + 1;
+
+    sumset_retain(a);
+
+    return new_node;
+}
+
+// Create a root node holding the given sumset, in the given width (0 for the generic one).
+static Ref_sumset* sumset_root(RefSumsetPool* pool, const Sumset* sumset, int d, int words) {
+    Ref_sumset* root = pool_allocate(pool);
+
+    if (words) {
+        sumset_fixed_of(&root->fixed, sumset, words);
+    } else {
+        root->this_sumset = *sumset;
+        root->mask = sumset_mask_of(sumset);
+    }
+
+    root->parent = NULL;
+    root->ref_count = 1;
+    root->size = sumset_size_lower_bound(sumset, d);
+
+    return root;
+}
+
+// Last element added to a node.
+static inline int sumset_last(const Search* search, const Ref_sumset* node) {
+    return search->words ? node->fixed.last : node->this_sumset.last;
+}
+
+/*
+ * Rebuild the Sumsets of a node of a fixed-width search and of its ancestors, root first.
+ * Returns the index of the node's own in sumsets.
+ */
+static size_t sumset_rebuild(const Search* search, const InputData* input_data, const Ref_sumset* node,
+                             Sumset* sumsets) {
+    if (!node->parent) {
+        sumsets[0] = node == search->roots[0] ? input_data->a_start : input_data->b_start;
+        return 0;
+    }
+
+    size_t k = sumset_rebuild(search, input_data, node->parent, sumsets) + 1;
+    sumset_add(&sumsets[k], &sumsets[k - 1], node->fixed.last);
+
+    return k;
+}
+
+// Build the solution of the nodes a and b. The nodes of a fixed-width search get their Sumsets rebuilt first.
+__attribute__((noinline)) static void sumset_solution_build(Solution* solution, const Search* search,
+                                                           InputData* input_data, const Ref_sumset* a,
+                                                           const Ref_sumset* b) {
+    if (!search->words) {
+        solution_build(solution, input_data, &a->this_sumset, &b->this_sumset);
+        return;
+    }
+
+    // A node has at least as many elements as ancestors.
+    Sumset* a_sumsets = malloc(sizeof(Sumset) * (a->size + 1));
+    Sumset* b_sumsets = malloc(sizeof(Sumset) * (b->size + 1));
+
+    if (!a_sumsets || !b_sumsets) {
+        exit(ERROR);
+    }
+
+    size_t a_k = sumset_rebuild(search, input_data, a, a_sumsets);
+    size_t b_k = sumset_rebuild(search, input_data, b, b_sumsets);
+    solution_build(solution, input_data, &a_sumsets[a_k], &b_sumsets[b_k]);
+
+    free(a_sumsets);
+    free(b_sumsets);
+}
+
+
+/*
+ * Functions for the stack.
+ */
+
+static StackChunk* stack_chunk_new(StackChunk* below) {
+    StackChunk* chunk = mmap(NULL, sizeof(StackChunk), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if (chunk == MAP_FAILED) {
+        exit(ERROR);
+    }
+
+    chunk->below = below;
+    return chunk;
+}
+
+static void stack_chunk_free(StackChunk* chunk) {
+    if (chunk) {
+        munmap(chunk, sizeof(StackChunk));
+    }
+}
+
+void stack_init(Stack* stack) {
+    stack->chunk = stack_chunk_new(NULL);
+    stack->top = stack->chunk->frames;
+    stack->spare = NULL;
+    stack->chunks = 1;
+    stack->max_chunks = 1;
+}
+
+// Put a chunk on top of the full top chunk.
+static void stack_grow(Stack* stack) {
+    StackChunk* chunk = stack->spare;
+
+    if (chunk) {
+        chunk->below = stack->chunk;
+        stack->spare = NULL;
+    } else {
+        chunk = stack_chunk_new(stack->chunk);
+    }
+
+    stack->chunk = chunk;
+    stack->top = chunk->frames;
+
+    if (++stack->chunks > stack->max_chunks) {
+        stack->max_chunks = stack->chunks;
+    }
+}
+
+// Drop the empty top chunk, keeping it as the spare. Returns false if it is the last one.
+static bool stack_shrink(Stack* stack) {
+    StackChunk* chunk = stack->chunk;
+
+    if (!chunk->below) {
+        return false;
+    }
+
+    stack_chunk_free(stack->spare);
+    stack->spare = chunk;
+    stack->chunk = chunk->below;
+    stack->top = stack->chunk->frames + STACK_CHUNK_FRAMES;
+    stack->chunks--;
+
+    return true;
+}
+
+// Push a frame. The stack takes over the references held by the frame.
+static inline void stack_push(Stack* stack, StackFrame frame) {
+    if (stack->top == stack->chunk->frames + STACK_CHUNK_FRAMES) {
+        stack_grow(stack);
+    }
+
+    *stack->top++ = frame;
+}
+
+// Pop the last pushed frame. Returns false if the stack is empty.
+static inline bool stack_pop(Stack* stack, StackFrame* frame) {
+    if (stack->top == stack->chunk->frames && !stack_shrink(stack)) {
+        return false;
+    }
+
+    *frame = *--stack->top;
+    return true;
+}
+
+void stack_destroy(Stack* stack) {
+    StackChunk* chunk = stack->chunk;
+
+    while (chunk) {
+        StackChunk* below = chunk->below;
+        stack_chunk_free(chunk);
+        chunk = below;
+    }
+
+    stack_chunk_free(stack->spare);
+}
+
 
 /*
- * Solve the problem iteratively.
+ * Functions for snapshots.
  */
-void solve_iterative(Sumset* start_a, Sumset* start_b, Solution* best_solution, InputData* input_data, RefSumsetPool* pool) {
-    size_t stack_capacity = 1000;
-    StackFrame* stack = malloc(sizeof(StackFrame) * stack_capacity);
-    size_t stack_size = 0;
 
-    Ref_sumset* a_beg = pool_allocate(pool);
-    Ref_sumset* b_beg = pool_allocate(pool);
+// Get the snapshot id of a node, adding it and its ancestors if needed.
+static int snapshot_add_ref(Snapshot* snapshot, const Search* search, const Ref_sumset* node) {
+    if (node == search->roots[0]) {
+        return SNAPSHOT_ROOT_A;
+    }
+    if (node == search->roots[1]) {
+        return SNAPSHOT_ROOT_B;
+    }
+
+    int id = snapshot_find(snapshot, node);
+    if (id < 0) {
+        int parent = snapshot_add_ref(snapshot, search, node->parent);
+        id = snapshot_add_node(snapshot, node, parent, sumset_last(search, node));
+    }
+
+    return id;
+}
+
+// Add the frames of a chunk, below its top, and of the chunks under it, bottom first.
+static void snapshot_add_chunk(Snapshot* snapshot, const Search* search, const StackChunk* chunk,
+                               const StackFrame* top) {
+    if (chunk->below) {
+        snapshot_add_chunk(snapshot, search, chunk->below, chunk->below->frames + STACK_CHUNK_FRAMES);
+    }
+
+    for (const StackFrame* frame = chunk->frames; frame < top; ++frame) {
+        int a = snapshot_add_ref(snapshot, search, frame->a);
+        snapshot_add_frame(snapshot, a, snapshot_add_ref(snapshot, search, frame->b));
+    }
+}
+
+// Write the frames of the stack and the best solution to the snapshot file.
+void snapshot_take(const Search* search, const Stack* stack, const Solution* best_solution,
+                   InputData* input_data, const Options* options, Stats* stats) {
+    Snapshot snapshot;
+    snapshot_init(&snapshot, input_data);
+    snapshot_add_chunk(&snapshot, search, stack->chunk, stack->top);
+
+    if (search->best.a) {
+        snapshot.best_sum = best_solution->sum;
+        snapshot.best_a = snapshot_add_ref(&snapshot, search, search->best.a);
+        snapshot.best_b = snapshot_add_ref(&snapshot, search, search->best.b);
+    }
+
+    if (snapshot_write(&snapshot, options->checkpoint)) {
+        stats->snapshots++;
+    } else {
+        perror(options->checkpoint);
+    }
+
+    snapshot_destroy(&snapshot);
+}
+
+// Rebuild the frames and the best solution of a snapshot.
+void snapshot_restore(const Snapshot* snapshot, Search* search, Stack* stack, Solution* best_solution,
+                      InputData* input_data, RefSumsetPool* pool) {
+    Ref_sumset** nodes = malloc(sizeof(Ref_sumset*) * snapshot->nodes_count);
+
+    if (!nodes) {
+        exit(ERROR);
+    }
+
+    nodes[SNAPSHOT_ROOT_A] = search->roots[0];
+    nodes[SNAPSHOT_ROOT_B] = search->roots[1];
+
+    for (size_t k = 2; k < snapshot->nodes_count; ++k) {
+        nodes[k] = sumset_extend(pool, nodes[snapshot->nodes[k].parent], snapshot->nodes[k].element, search->words);
+    }
 
-    a_beg->this_sumset = *start_a;
-    b_beg->this_sumset = *start_b;
-    a_beg->ref_count = 2;
-    b_beg->ref_count = 2;
-    a_beg->parent = NULL;
-    b_beg->parent = NULL;
+    for (size_t k = 0; k < snapshot->frames_count; ++k) {
+        StackFrame frame = {nodes[snapshot->frames[k].a], nodes[snapshot->frames[k].b]};
+
+        sumset_retain(frame.a);
+        sumset_retain(frame.b);
+        stack_push(stack, frame);
+    }
+
+    if (snapshot->best_a >= 0) {
+        search->best = (StackFrame){nodes[snapshot->best_a], nodes[snapshot->best_b]};
+        sumset_retain(search->best.a);
+        sumset_retain(search->best.b);
+        sumset_solution_build(best_solution, search, input_data, search->best.a, search->best.b);
+    }
+
+    // Drop the references of the table, nodes outside all frames are freed.
+    for (size_t k = 2; k < snapshot->nodes_count; ++k) {
+        sumset_release(pool, nodes[k]);
+    }
+
+    free(nodes);
+}
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Check whether the search has reached one of its limits, recording which one.
+static bool limit_reached(Search* search, const Options* options, const Stats* stats, double time) {
+    if (time >= search->deadline) {
+        search->stop_reason = "time limit";
+    } else if (options->node_limit && stats->nodes >= options->node_limit) {
+        search->stop_reason = "node limit";
+    }
+
+    return search->stop_reason != NULL;
+}
+
+
+// Check whether no solution extending multisets with the given sums and sizes can beat the best one.
+static inline bool can_prune(const Options* options, const Solution* best_solution, int d,
+                             int a_sum, int a_size, int b_sum, int b_size) {
+    return options->prune && solution_upper_bound(a_sum, a_size, b_sum, b_size, d) <= best_solution->sum;
+}
+
+/*
+ * Solve the problem iteratively, starting from the frames on the stack, exploring the
+ * children of each node in the given order. The nodes hold fixed sumsets of the given
+ * number of words or, if it is 0, generic ones (see common/sumset_fixed.h).
+ */
+static inline __attribute__((always_inline))
+void solve_ordered(Stack* stack_in, Search* search, Solution* best_solution, InputData* input_data,
+                   RefSumsetPool* pool, const Options* options, Stats* stats, ChildOrder order, int words) {
+    Stack stack = *stack_in; // A local copy stays in registers.
+    size_t clock_countdown = CLOCK_PERIOD;
+
+    StackFrame frame;
+
+    bool anytime = options->time_limit || options->node_limit; // Report each improvement
+    bool timed = options->checkpoint || anytime;
+
+    while (stack_pop(&stack, &frame)) {
+        if (timed && --clock_countdown == 0) {
+            clock_countdown = CLOCK_PERIOD;
+            double time = now();
+
+            // The frame stays on the stack, for the final snapshot.
+            if (limit_reached(search, options, stats, time)) {
+                stack_push(&stack, frame);
+                break;
+            }
 
-    stack[stack_size++] = (StackFrame){a_beg, b_beg};
+            if (options->checkpoint && time >= search->next_snapshot) {
+                stack_push(&stack, frame); // Snapshot the frame too.
+                snapshot_take(search, &stack, best_solution, input_data, options, stats);
+                stack_pop(&stack, &frame);
+                search->next_snapshot = now() + options->interval;
+            }
+        }
 
-    while (stack_size > 0) {
-        StackFrame frame = stack[--stack_size];
         Ref_sumset *a, *b;
 
-        if (frame.a->this_sumset.sum > frame.b->this_sumset.sum) {
+        if ((words ? frame.a->fixed.sum : frame.a->this_sumset.sum) >
+            (words ? frame.b->fixed.sum : frame.b->this_sumset.sum)) {
             a = frame.b;
             b = frame.a;
         } else {
@@ -147,33 +533,68 @@ void solve_iterative(Sumset* start_a, Sumset* start_b, Solution* best_solution,
             b = frame.b;
         }
 
-        if (is_sumset_intersection_trivial(&a->this_sumset, &b->this_sumset)) {
-            for (int i = a->this_sumset.last; i <= input_data->d; ++i) {
-                if (!does_sumset_contain(&b->this_sumset, i)) {
-                    Ref_sumset* new_node = pool_allocate(pool);
-                    sumset_add(&new_node->this_sumset, &a->this_sumset, i);
+        int a_sum = words ? a->fixed.sum : a->this_sumset.sum;
+        int b_sum = words ? b->fixed.sum : b->this_sumset.sum;
 
-                    new_node->parent = a;
-                    new_node->ref_count = 1;
+        // The best solution may have improved since the frame was pushed.
+        if (can_prune(options, best_solution, input_data->d, a_sum, a->size, b_sum, b->size)) {
+            stats->pruned++;
+            sumset_release(pool, a);
+            sumset_release(pool, b);
+            continue;
+        }
+        stats->nodes++;
+
+        // The first fixed word holds the subset sums below 64, as a SumsetMask.
+        SumsetMask a_mask = words ? a->fixed.words[0] : a->mask;
+        SumsetMask b_mask = words ? b->fixed.words[0] : b->mask;
+        int a_last = words ? a->fixed.last : a->this_sumset.last;
+        int b_last = words ? b->fixed.last : b->this_sumset.last;
+
+        bool trivial = words ? sumset_fixed_is_intersection_trivial(&a->fixed, &b->fixed, words)
+                             : sumset_mask_may_be_trivial(a_mask, b_mask) &&
+                               is_sumset_intersection_trivial(&a->this_sumset, &b->this_sumset);
+
+        if (trivial) {
+            SumsetMask extensions = sumset_mask_extensions(b_mask, a_last, input_data->d);
+            ChildParent parent = {a_mask, b_mask, a_sum, b_sum, b_last, input_data->d};
+            ChildIterator children;
+            int8_t buffer[64];
+            int i;
+
+            // Push the children in reverse, so that they are popped in order.
+            child_iterator_init(&children, order, true, extensions, &parent, &search->scores, buffer);
+
+            while (child_iterator_next(&children, &i)) {
+                // The bound of a child depends only on its sum and size.
+                if (can_prune(options, best_solution, input_data->d, a_sum + i, a->size + 1, b_sum, b->size)) {
+                    stats->pruned++;
+                    continue;
+                }
 
-                    sumset_retain(a);
-                    sumset_retain(b);
+                Ref_sumset* new_node = sumset_extend(pool, a, i, words);
+                sumset_retain(b);
 
-                    if (stack_size >= stack_capacity) {
-                        stack_capacity *= 2;
-                        stack = realloc(stack, sizeof(StackFrame) * stack_capacity);
+                stack_push(&stack, (StackFrame){new_node, b});
+            }
+        } else if (a_sum == b_sum &&
+                   (words ? sumset_fixed_intersection_size(&a->fixed, &b->fixed, words)
+                          : (int)get_sumset_intersection_size(&a->this_sumset, &b->this_sumset)) == 2) {
+            child_scores_credit(&search->scores, a_last, b_last);
 
-                        if (!stack) {
-                            exit(ERROR);
-                        }
-                    }
+            if (b_sum > best_solution->sum) {
+                sumset_solution_build(best_solution, search, input_data, a, b);
 
-                    stack[stack_size++] = (StackFrame){new_node, b};
+                if (anytime) {
+                    fprintf(stderr, "best %d after %.3f s\n", best_solution->sum, now() - search->start_time);
                 }
-            }
-        } else if ((a->this_sumset.sum == b->this_sumset.sum) && (get_sumset_intersection_size(&a->this_sumset, &b->this_sumset) == 2)) {
-            if (b->this_sumset.sum > best_solution->sum) {
-                solution_build(best_solution, input_data, &a->this_sumset, &b->this_sumset);
+
+                // Keep the nodes of the best solution for the snapshots.
+                sumset_release(pool, search->best.a);
+                sumset_release(pool, search->best.b);
+                sumset_retain(a);
+                sumset_retain(b);
+                search->best = (StackFrame){a, b};
             }
         }
 
@@ -181,10 +602,133 @@ void solve_iterative(Sumset* start_a, Sumset* start_b, Solution* best_solution,
         sumset_release(pool, b);
     }
 
-    free(stack);
+    *stack_in = stack;
+}
+
+// Define the search on sumsets of the given width in words (0 for the generic ones), see solve_iterative.
+#define SOLVE_ITERATIVE(name, words)                                                                          \
+    SUMSET_DISPATCH                                                                                           \
+    void name(Stack* stack_in, Search* search, Solution* best_solution, InputData* input_data,                \
+              RefSumsetPool* pool, const Options* options, Stats* stats) {                                    \
+        if (options->order == ORDER_DESCENDING) {                                                             \
+            solve_ordered(stack_in, search, best_solution, input_data, pool, options, stats, ORDER_DESCENDING, \
+                          words);                                                                             \
+        } else {                                                                                              \
+            solve_ordered(stack_in, search, best_solution, input_data, pool, options, stats, options->order,   \
+                          words);                                                                             \
+        }                                                                                                     \
+    }
+
+SOLVE_ITERATIVE(solve_iterative_generic, 0)
+SOLVE_ITERATIVE(solve_iterative_64, 1)
+SOLVE_ITERATIVE(solve_iterative_128, 2)
+SOLVE_ITERATIVE(solve_iterative_256, 4)
+SOLVE_ITERATIVE(solve_iterative_512, 8)
+
+/*
+ * Solve the problem iteratively, starting from the frames on the stack, in the search's width.
+ * Each width and the default order get a copy of their own, in which the kernels unroll
+ * and the children come straight from the mask.
+ */
+void solve_iterative(Stack* stack_in, Search* search, Solution* best_solution, InputData* input_data, RefSumsetPool* pool,
+                     const Options* options, Stats* stats) {
+    switch (search->words) {
+        case 0:
+            solve_iterative_generic(stack_in, search, best_solution, input_data, pool, options, stats);
+            break;
+        case 1:
+            solve_iterative_64(stack_in, search, best_solution, input_data, pool, options, stats);
+            break;
+        case 2:
+            solve_iterative_128(stack_in, search, best_solution, input_data, pool, options, stats);
+            break;
+        case 4:
+            solve_iterative_256(stack_in, search, best_solution, input_data, pool, options, stats);
+            break;
+        default:
+            solve_iterative_512(stack_in, search, best_solution, input_data, pool, options, stats);
+            break;
+    }
+}
+
+// Parse the command line options.
+void options_parse(Options* options, int argc, char* argv[]) {
+    static const struct option long_options[] = {
+        {"no-prune", no_argument, NULL, 'P'},
+        {"stats", no_argument, NULL, 's'},
+        {"checkpoint", required_argument, NULL, 'k'},
+        {"interval", required_argument, NULL, 'i'},
+        {"resume", required_argument, NULL, 'r'},
+        {"order", required_argument, NULL, 'o'},
+        {"time-limit", required_argument, NULL, 't'},
+        {"node-limit", required_argument, NULL, 'n'},
+        {NULL, 0, NULL, 0}
+    };
+
+    options->prune = true;
+    options->stats = false;
+    options->checkpoint = NULL;
+    options->interval = 600;
+    options->resume = NULL;
+    options->order = ORDER_DESCENDING;
+    options->time_limit = 0;
+    options->node_limit = 0;
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "Psk:i:r:o:t:n:", long_options, NULL)) != -1) {
+        switch (opt) {
+            case 'P':
+                options->prune = false;
+                break;
+            case 's':
+                options->stats = true;
+                break;
+            case 'k':
+                options->checkpoint = optarg;
+                break;
+            case 'i':
+                options->interval = strtod(optarg, NULL);
+                if (!(options->interval > 0)) {
+                    fprintf(stderr, "Invalid snapshot interval: %s\n", optarg);
+                    exit(ERROR);
+                }
+                break;
+            case 'r':
+                options->resume = optarg;
+                break;
+            case 'o':
+                if (!child_order_parse(optarg, &options->order)) {
+                    fprintf(stderr, "Unknown child order: %s\n", optarg);
+                    exit(ERROR);
+                }
+                break;
+            case 't':
+                options->time_limit = strtod(optarg, NULL);
+                if (!(options->time_limit > 0)) {
+                    fprintf(stderr, "Invalid time limit: %s\n", optarg);
+                    exit(ERROR);
+                }
+                break;
+            case 'n':
+                options->node_limit = strtoull(optarg, NULL, 10);
+                if (options->node_limit == 0) {
+                    fprintf(stderr, "Invalid node limit: %s\n", optarg);
+                    exit(ERROR);
+                }
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [--no-prune] [--stats] [--checkpoint file] [--interval seconds] "
+                                "[--resume file] [--order descending|ascending|capacity|learned] "
+                                "[--time-limit seconds] [--node-limit nodes] < input\n", argv[0]);
+                exit(ERROR);
+        }
+    }
 }
 
-int main() {
+int main(int argc, char* argv[]) {
+    Options options;
+    options_parse(&options, argc, argv);
+
     InputData input_data;
     input_data_read(&input_data);
 
@@ -194,9 +738,75 @@ int main() {
     RefSumsetPool pool;
     pool_init(&pool);
 
-    solve_iterative(&input_data.a_start, &input_data.b_start, &best_solution, &input_data, &pool);
+    int words = sumset_fixed_words(&input_data);
+    Search search = {
+        .roots = {sumset_root(&pool, &input_data.a_start, input_data.d, words),
+                  sumset_root(&pool, &input_data.b_start, input_data.d, words)},
+        .best = {NULL, NULL},
+        .next_snapshot = now() + options.interval,
+        .start_time = now(),
+        .deadline = options.time_limit ? now() + options.time_limit : INFINITY,
+        .stop_reason = NULL,
+        .words = words
+    };
+
+    Stack stack;
+    stack_init(&stack);
+
+    if (options.resume) {
+        Snapshot snapshot;
+        if (!snapshot_read(&snapshot, options.resume, &input_data)) {
+            exit(ERROR);
+        }
+
+        snapshot_restore(&snapshot, &search, &stack, &best_solution, &input_data, &pool);
+        snapshot_destroy(&snapshot);
+    } else {
+        sumset_retain(search.roots[0]);
+        sumset_retain(search.roots[1]);
+        stack_push(&stack, (StackFrame){search.roots[0], search.roots[1]});
+    }
+
+    Stats stats = {0, 0, 0};
+    solve_iterative(&stack, &search, &best_solution, &input_data, &pool, &options, &stats);
+
+    // The final snapshot holds the frames left by a limit. Without them, resuming from it only prints the solution.
+    if (options.checkpoint) {
+        snapshot_take(&search, &stack, &best_solution, &input_data, &options, &stats);
+    }
 
     solution_print(&best_solution);
+
+    if (options.time_limit || options.node_limit) {
+        if (search.stop_reason) {
+            fprintf(stderr, "search stopped by the %s after %.3f s and %zu nodes, the solution may not be optimal\n",
+                    search.stop_reason, now() - search.start_time, stats.nodes);
+        } else {
+            fprintf(stderr, "search finished after %.3f s and %zu nodes\n", now() - search.start_time, stats.nodes);
+        }
+    }
+
+    if (options.stats) {
+        fprintf(stderr, "kernels: %s\n", sumset_dispatch_isa());
+        if (search.words) {
+            fprintf(stderr, "sumsets: %d bits\n", 64 * search.words);
+        } else {
+            fprintf(stderr, "sumsets: generic\n");
+        }
+        fprintf(stderr, "nodes: %zu\npruned: %zu\n", stats.nodes, stats.pruned);
+        fprintf(stderr, "stack: at most %zu chunks of %d frames\n", stack.max_chunks, STACK_CHUNK_FRAMES);
+
+        if (options.checkpoint) {
+            fprintf(stderr, "snapshots: %zu\n", stats.snapshots);
+        }
+    }
+
+    sumset_release(&pool, search.best.a);
+    sumset_release(&pool, search.best.b);
+    sumset_release(&pool, search.roots[0]);
+    sumset_release(&pool, search.roots[1]);
+    stack_destroy(&stack);
+
     pool_destroy(&pool);
     return 0;
 }
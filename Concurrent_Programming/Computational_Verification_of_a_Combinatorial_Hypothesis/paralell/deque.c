@@ -0,0 +1,155 @@
+#include <stdlib.h>
+
+#include "deque.h"
+
+
+// Constants
+enum {
+    ERROR = 1
+};
+
+
+/*
+ * Functions for the circular array.
+ */
+
+// Allocate an array with the given capacity.
+static DequeArray* deque_array_new(int64_t capacity, DequeArray* retired) {
+    DequeArray* array = malloc(sizeof(DequeArray) + sizeof(DequeSlot) * capacity);
+
+    if (!array) {
+        exit(ERROR);
+    }
+
+    array->capacity = capacity;
+    array->retired = retired;
+
+    return array;
+}
+
+static inline void deque_array_put(DequeArray* array, int64_t index, StackFrame frame) {
+    DequeSlot* slot = &array->slots[index & (array->capacity - 1)];
+    atomic_store_explicit(&slot->a, frame.a, memory_order_relaxed);
+    atomic_store_explicit(&slot->b, frame.b, memory_order_relaxed);
+    atomic_store_explicit(&slot->element, frame.element, memory_order_relaxed);
+}
+
+static inline StackFrame deque_array_get(DequeArray* array, int64_t index) {
+    DequeSlot* slot = &array->slots[index & (array->capacity - 1)];
+    return (StackFrame){
+        atomic_load_explicit(&slot->a, memory_order_relaxed),
+        atomic_load_explicit(&slot->b, memory_order_relaxed),
+        atomic_load_explicit(&slot->element, memory_order_relaxed)
+    };
+}
+
+// Double the capacity of the array, copying frames between top and bottom.
+static DequeArray* deque_grow(WorkDeque* deque, DequeArray* array, int64_t top, int64_t bottom) {
+    DequeArray* bigger = deque_array_new(array->capacity * 2, array);
+
+    for (int64_t i = top; i < bottom; ++i) {
+        deque_array_put(bigger, i, deque_array_get(array, i));
+    }
+    atomic_store_explicit(&deque->array, bigger, memory_order_release);
+
+    return bigger;
+}
+
+
+/*
+ * Functions for deque management.
+ */
+
+void deque_init(WorkDeque* deque, int64_t capacity) {
+    int64_t rounded = 1;
+    while (rounded < capacity) {
+        rounded *= 2;
+    }
+
+    atomic_init(&deque->top, 0);
+    atomic_init(&deque->bottom, 0);
+    atomic_init(&deque->array, deque_array_new(rounded, NULL));
+}
+
+void deque_destroy(WorkDeque* deque) {
+    DequeArray* array = atomic_load_explicit(&deque->array, memory_order_relaxed);
+
+    while (array) {
+        DequeArray* retired = array->retired;
+        free(array);
+        array = retired;
+    }
+
+    atomic_store_explicit(&deque->array, NULL, memory_order_relaxed);
+}
+
+void deque_push(WorkDeque* deque, StackFrame frame) {
+    int64_t bottom = atomic_load_explicit(&deque->bottom, memory_order_relaxed);
+    int64_t top = atomic_load_explicit(&deque->top, memory_order_acquire);
+    DequeArray* array = atomic_load_explicit(&deque->array, memory_order_relaxed);
+
+    if (bottom - top > array->capacity - 1) {
+        array = deque_grow(deque, array, top, bottom);
+    }
+
+    deque_array_put(array, bottom, frame);
+    atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_release);
+}
+
+bool deque_take(WorkDeque* deque, StackFrame* frame) {
+    int64_t bottom = atomic_load_explicit(&deque->bottom, memory_order_relaxed) - 1;
+    DequeArray* array = atomic_load_explicit(&deque->array, memory_order_relaxed);
+
+    atomic_store_explicit(&deque->bottom, bottom, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    int64_t top = atomic_load_explicit(&deque->top, memory_order_relaxed);
+
+    if (top > bottom) { // The deque was empty.
+        atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_relaxed);
+        return false;
+    }
+
+    *frame = deque_array_get(array, bottom);
+
+    if (top == bottom) { // Last frame: race against thieves for it.
+        bool won = atomic_compare_exchange_strong_explicit(&deque->top, &top, top + 1,
+                                                           memory_order_seq_cst, memory_order_relaxed);
+        atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_relaxed);
+        return won;
+    }
+
+    return true;
+}
+
+bool deque_steal(WorkDeque* deque, StackFrame* frame) {
+    int64_t top = atomic_load_explicit(&deque->top, memory_order_acquire);
+    atomic_thread_fence(memory_order_seq_cst);
+    int64_t bottom = atomic_load_explicit(&deque->bottom, memory_order_acquire);
+
+    if (top >= bottom) {
+        return false;
+    }
+
+    DequeArray* array = atomic_load_explicit(&deque->array, memory_order_acquire);
+    StackFrame stolen = deque_array_get(array, top);
+
+    if (!atomic_compare_exchange_strong_explicit(&deque->top, &top, top + 1,
+                                                 memory_order_seq_cst, memory_order_relaxed)) {
+        return false; // Lost the race against the owner or another thief.
+    }
+
+    *frame = stolen;
+    return true;
+}
+
+int64_t deque_copy(WorkDeque* deque, StackFrame* frames) {
+    int64_t top = atomic_load_explicit(&deque->top, memory_order_relaxed);
+    int64_t bottom = atomic_load_explicit(&deque->bottom, memory_order_relaxed);
+    DequeArray* array = atomic_load_explicit(&deque->array, memory_order_relaxed);
+
+    for (int64_t i = top; i < bottom; ++i) {
+        frames[i - top] = deque_array_get(array, i);
+    }
+
+    return bottom > top ? bottom - top : 0;
+}
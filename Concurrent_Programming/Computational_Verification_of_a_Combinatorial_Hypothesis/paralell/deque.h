@@ -0,0 +1,74 @@
+#pragma once
+
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+
+struct Ref_sumset;
+
+/*
+ * Structure representing a stack frame: the pair of multisets (a, b), or, in a delta
+ * frame, (a + element, b). A delta frame holds a reference to the parent a instead of
+ * a node of its own, which is built only when the frame is popped.
+ */
+typedef struct {
+    struct Ref_sumset* a;
+    struct Ref_sumset* b;
+    int element;               // Element added to a (or 0)
+} StackFrame;
+
+// A single deque slot. Thieves may read a slot while the owner overwrites it,
+// so all fields are atomics accessed with relaxed ordering.
+typedef struct {
+    _Atomic(struct Ref_sumset*) a;
+    _Atomic(struct Ref_sumset*) b;
+    atomic_int element;
+} DequeSlot;
+
+// Circular array backing a deque. Replaced arrays are kept on the retired
+// list until the deque is destroyed, because a thief may still read them.
+typedef struct DequeArray {
+    int64_t capacity;            // Always a power of two
+    struct DequeArray* retired;  // Previously used array (or NULL)
+    DequeSlot slots[];
+} DequeArray;
+
+/*
+ * Chase-Lev work-stealing deque.
+ * The owner pushes and takes at the bottom without locks, thieves steal from the top.
+ */
+typedef struct {
+    alignas(64) atomic_int_least64_t top;     // Next index to steal
+    alignas(64) atomic_int_least64_t bottom;  // Next index to push (owner only)
+    _Atomic(DequeArray*) array;
+} WorkDeque;
+
+
+// Initialize the deque with the given initial capacity (rounded up to a power of two).
+void deque_init(WorkDeque* deque, int64_t capacity);
+
+// Free all arrays used by the deque. No other thread may use it anymore.
+void deque_destroy(WorkDeque* deque);
+
+// Push a frame at the bottom. Owner only.
+void deque_push(WorkDeque* deque, StackFrame frame);
+
+// Take the most recently pushed frame. Owner only. Returns false if the deque is empty.
+bool deque_take(WorkDeque* deque, StackFrame* frame);
+
+// Steal the oldest frame. Returns false if the deque is empty or the race was lost.
+bool deque_steal(WorkDeque* deque, StackFrame* frame);
+
+// Copy the frames of the deque, oldest first, and return their number.
+// No thread may use the deque meanwhile.
+int64_t deque_copy(WorkDeque* deque, StackFrame* frames);
+
+// Approximate number of frames in the deque.
+static inline int64_t deque_size(WorkDeque* deque) {
+    int64_t top = atomic_load(&deque->top);
+    int64_t bottom = atomic_load(&deque->bottom);
+
+    return bottom > top ? bottom - top : 0;
+}
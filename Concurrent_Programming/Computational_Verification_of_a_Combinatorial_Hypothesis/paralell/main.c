@@ -4,18 +4,85 @@
 #include <stdatomic.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <stdalign.h>
+#include <sched.h>
+#include <stdio.h>
+#include <getopt.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <ctype.h>
 
 #include "common/io.h"
 #include "common/sumset.h"
 #include "common/err.h"
+#include "common/bound.h"
+#include "common/sumset_dispatch.h"
+#include "common/sumset_mask.h"
+#include "common/sumset_fixed.h"
+#include "common/child_order.h"
+#include "common/snapshot.h"
+#include "common/tree_estimate.h"
+#include "common/results.h"
+#include "deque.h"
+#include "shard.h"
+#include "topology.h"
+#include "visited.h"
 
 
 // Constants
 enum {
     ERROR = 1,
-    POOL_BLOCK_SIZE = 1000 // Number of Ref_sumset structures per block
+    POOL_BLOCK_SIZE = 1000,    // Number of Ref_sumset structures per block
+    DEQUE_CAPACITY = 1024,     // Initial capacity of each thread's deque
+    STEAL_ROUNDS = 64,         // Failed rounds of stealing before an idle thread sleeps
+    GRAIN_WINDOW = 32,         // Granularity decisions between adjustments of the cutoff
+    GRAIN_SURPLUS = 4,         // Deque size above which a busy thread may keep more work private
+    SHARD_POLL_MS = 10,        // Coordinator's wait between split requests answered with no frames
+    LIMIT_POLL_MS = 10,        // Main thread's wait between checks of the node limit
+    PROGRESS_WALKS = 1000,     // Walks of the tree estimate added for each progress line
+    PARTITION_WALKS = 1 << 18, // Walks of the tree estimate shared by the tasks of the static partition
+    PARTITION_TASK_WALKS = 64, // Most walks for a single task, the least is 4
+    PARTITION_PROBE = 10000,   // Nodes of the dive seeding the best sum of the static partition
+    VISITED_DEPTH = 4          // Default deepest pairs looked up in the visited table
 };
 
+// Bounds and default of the granularity cutoff, in nodes of a private subtree.
+static const double GRAIN_MIN_CUTOFF = 16.0;
+static const double GRAIN_MAX_CUTOFF = 1e9;
+static const double GRAIN_DEFAULT_CUTOFF = 4096.0;
+
+// Length of the calibration run of the estimator, in seconds, unless a limit is given.
+static const double ESTIMATE_CALIBRATION = 1.0;
+
+// Result of scheduler_pop.
+typedef enum {
+    POP_NONE = 0,              // No more work
+    POP_OWN,                   // Frame taken from the thread's own deque
+    POP_STOLEN,                // Frame stolen from another thread
+    POP_TASK                   // Task of the static partition, see search_partition
+} PopResult;
+
+// Policy deciding whether a frame's subtree is solved privately or published.
+typedef enum {
+    GRAIN_QUEUE,               // Publish while the own deque holds fewer than 2 frames
+    GRAIN_STATIC,              // Fixed cutoff on the estimated subtree cost
+    GRAIN_ADAPTIVE             // Cutoff adapted from steal and idle statistics
+} GrainPolicy;
+
+// Counters of the scheduler's hot paths (pushes, pops, steals, waits). Build with
+// -DPARALLEL_COUNTERS=0 (cmake -DCOUNTERS=OFF) to compile them out.
+#ifndef PARALLEL_COUNTERS
+#define PARALLEL_COUNTERS 1
+#endif
+
+// A statistics counter, written only by its owner thread and readable by others while it runs.
+typedef atomic_size_t Counter;
+
 
 /*
  * Structures for stack memory management.
@@ -24,44 +91,328 @@ enum {
 // Structure representing a reference-counted sumset.
 typedef struct Ref_sumset {
     Sumset this_sumset;        // Pointer to the sumset
+    SumsetMask mask;           // Subset sums below 64, see common/sumset_mask.h
     atomic_int ref_count;      // Reference count for memory management
+    int size;                  // Number of elements of the multiset (lower bound for the roots)
     struct Ref_sumset* parent; // Pointer to the parent sumset
     struct Ref_sumset* next;   // Pointer to the next free node (for pooling)
+    struct RefSumsetPool* owner; // Pool the node was allocated from (NULL for the roots)
+    struct Instance* instance; // Instance of a batch the node belongs to (NULL outside batch mode)
 } Ref_sumset;
 
-// Structure representing a stack frame.
-typedef struct {
-    Ref_sumset* a;
-    Ref_sumset* b;
-} StackFrame;
+/*
+ * A node on the private recursion path of solve_recursive. Path nodes live on the
+ * thread's stack; a shared twin is created only when the node's siblings are donated.
+ * The fixed-width searches keep only the fixed sumset, see solve_recursive_ordered.
+ */
+typedef struct PathNode {
+    union {
+        Sumset sumset;
+        SumsetFixed fixed;     // Subset sums in the search's width, see common/sumset_fixed.h
+    };
+    SumsetMask mask;           // Subset sums below 64 (the generic search only)
+    int size;                  // Number of elements of the multiset
+    int element;               // Element added to the parent
+    struct PathNode* parent;   // Parent on the path, NULL for the frame's own multisets
+    Ref_sumset* twin;          // Shared node with the same multiset (or NULL)
+} PathNode;
+
+// Block of Ref_sumset structures.
+typedef struct PoolBlock {
+    struct PoolBlock* next;     // Next allocated block
+    Ref_sumset nodes[POOL_BLOCK_SIZE];
+} PoolBlock;
 
-// Memory pool for Ref_sumset
-typedef struct {
+/*
+ * Memory pool for Ref_sumset, owned by a single thread.
+ * Nodes released by other threads are pushed onto the lock-free remote_free
+ * list and taken back by the owner in one batch when its free list runs out.
+ */
+typedef struct RefSumsetPool {
     Ref_sumset* free_list;      // Head of the free list
-    Ref_sumset* pool_blocks;    // Linked list of allocated blocks
+    PoolBlock* pool_blocks;     // Linked list of allocated blocks
+    size_t in_use;              // Nodes allocated and not yet returned to the free list
+    size_t high_water;          // Maximal value of in_use
+    Counter blocks;             // Number of allocated blocks
+    size_t remote_frees;        // Nodes returned through remote_free
+    alignas(64) _Atomic(Ref_sumset*) remote_free; // Nodes released by other threads
 } RefSumsetPool;
 
-// Global work queue structure.
+/*
+ * Search statistics of one thread. Each thread writes only its own, with counter_add,
+ * and they sit on their own cache lines; other threads may read them while it runs.
+ */
+typedef struct {
+    alignas(64) Counter nodes; // Number of expanded (a, b) pairs
+    Counter pruned;            // Number of subtrees cut by the bound
+    Counter recursive;         // Number of frames solved privately
+    Counter iterative;         // Number of frames whose children were published
+    Counter donated;           // Number of siblings published from private subtrees
+    Counter throttled_ns;      // Time spent over the memory budget, in nanoseconds
+    Counter visited_seen;      // Pairs skipped as found in the visited table
+    Counter visited_claimed;   // Pairs added to the visited table, in a free slot or evicting a deeper one
+    Counter visited_evicted;   // Pairs of the visited table replaced by shallower ones
+    Counter visited_dropped;   // Pairs not added, their bucket being full of shallower ones
+#if PARALLEL_COUNTERS
+    Counter peak_frames;       // Largest number of frames in the thread's deque
+    Counter pushes;            // Frames pushed onto the thread's deque
+    Counter pops;              // Frames taken from the thread's own deque
+    Counter steals;            // Frames stolen from other threads
+    Counter failed_steals;     // Steals lost to the owner or to another thief
+    Counter remote_steals;     // Frames stolen from threads pinned to another node
+    Counter waits;             // Sleeps on the scheduler's condition variable
+    Counter wait_ns;           // Time spent asleep, in nanoseconds
+#endif
+} Stats;
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static inline void counter_add(Counter* counter, size_t n) {
+    // A plain load and store, no read-modify-write: the counter has a single writer.
+    atomic_store_explicit(counter, atomic_load_explicit(counter, memory_order_relaxed) + n, memory_order_relaxed);
+}
+
+static inline size_t counter_get(Counter* counter) {
+    return atomic_load_explicit(counter, memory_order_relaxed);
+}
+
+#if PARALLEL_COUNTERS
+#define COUNT(stats, counter, n) counter_add(&(stats)->counter, (n))
+#else
+#define COUNT(stats, counter, n) ((void)0)
+#endif
+
+// State shared by all worker threads.
+typedef struct {
+    WorkDeque* deques;         // One work-stealing deque per thread
+    int t;                     // Number of worker threads
+    atomic_int idle_counter;   // Number of threads that found no work (termination detector)
+    atomic_bool done;          // Set once every thread is idle and all deques are empty
+    atomic_int sleepers;       // Number of threads blocked on cond
+    atomic_bool pause;         // Set while a snapshot waits for the threads to stop
+    atomic_bool stopped;       // Set when a limit ends the search early, see scheduler_abort
+    int paused;                // Number of threads stopped at a pause point
+    pthread_mutex_t mutex;     // Mutex protecting the sleep on cond and the pause
+    pthread_cond_t cond;       // Condition variable for sleeping idle threads
+    pthread_cond_t paused_cond; // Signalled when a thread pauses or the search finishes
+    pthread_cond_t resume_cond; // Broadcast when the paused threads may continue
+    Stats* stats;              // Counters of each thread, indexed like the deques
+    int finish_fd;             // Written to once the search finishes (or -1)
+    StackFrame* tasks;         // Tasks of the static partition, handed out in order (or NULL)
+    size_t tasks_count;
+    alignas(64) atomic_size_t next_task; // Index of the next task to hand out
+    int* nodes;                // NUMA node of each pinned thread (or NULL)
+    bool local_steals;         // Steal from threads on the thief's node first, see scheduler_pop
+} Scheduler;
+
+
+// Command line options.
+typedef struct {
+    bool prune;                // Cut subtrees that cannot beat the best solution
+    bool stats;                // Print search statistics to stderr
+    GrainPolicy grain;         // Task granularity policy
+    double cutoff;             // Initial (or fixed) granularity cutoff
+    bool delta;                // Push delta frames, see StackFrame
+    const char* checkpoint;    // Snapshot file (or NULL)
+    double interval;           // Seconds between snapshots
+    const char* resume;        // Snapshot to resume from (or NULL)
+    const char* coordinator;   // Socket of the coordinator to run (or NULL)
+    const char* worker;        // Socket of the coordinator to serve (or NULL)
+    int workers;               // Number of worker processes started by the coordinator
+    int prefix_depth;          // Depth to which the coordinator expands the tree
+    size_t memory_limit;       // Bytes the frontier may take, shared by the threads (0 for no limit)
+    bool batch;                // Solve every instance of the input, see batch_run
+    int sweep_last;            // Last d of a sweep from the input's d, see sweep_run (or 0)
+    ChildOrder order;          // Order of the children, see common/child_order.h
+    double time_limit;         // Seconds after which the search stops (0 for no limit)
+    size_t node_limit;         // Nodes after which the search stops (0 for no limit)
+    size_t estimate_walks;     // Walks of the estimator to run instead of the search, see estimate_run (or 0)
+    double progress;           // Seconds between progress lines (0 for none)
+    int partition_depth;       // Depth of the static partition, see search_partition (or -1 for none)
+    const char* tasks;         // File to write the tasks of the static partition to (or NULL)
+    AffinityPolicy affinity;   // Pinning of the worker threads, see paralell/topology.h
+    bool local_steals;         // Prefer victims on the thief's node when the threads are pinned
+    int top;                   // Number of best solutions to keep, see common/results.h (or 0)
+    bool all_optimal;          // Keep every optimal solution, see common/results.h
+    const char* results;       // File to write the kept solutions to
+    size_t visited_bytes;      // Memory of the visited table, see paralell/visited.h (0 for none)
+    int visited_depth;         // Deepest pairs looked up in the visited table
+} Options;
+
+/*
+ * Task granularity controller of a single thread.
+ * Estimates the cost of a subtree from d - last and the remaining headroom of the
+ * smaller sum, learning from the measured size of subtrees solved privately.
+ */
 typedef struct {
-    Sumset* start_a;
-    Sumset* start_b;
-    StackFrame* frames;        // Dynamic array of stack frames
-    size_t size;               // Current number of stack frames
-    size_t capacity;           // Maximum capacity of the stack
-    pthread_mutex_t mutex;     // Mutex for thread-safe operations
-    pthread_cond_t cond;       // Condition variable for waiting threads
-    int working_counter;       // Counter for active working threads
-} WorkQueue;
+    GrainPolicy policy;
+    double cutoff;             // Largest estimated cost solved privately
+    int decisions;             // Decisions since the last adjustment of the cutoff
+    int root_depth;            // Total size of the starting multisets
+    int d;                     // d of the input the costs were measured on
+    double* cost;              // Estimated nodes per (d - last, headroom) bucket
+} GrainController;
+
 
+typedef struct Worker Worker;
+typedef struct Batch Batch;
+
+/*
+ * Best solutions of a sweep over d. The level of a pair is its largest element, at least
+ * the first d; a solution of level m is one for every d >= m.
+ */
+typedef struct {
+    int first;                 // First d of the sweep, the input's
+    int last;                  // Last d, the one searched
+    atomic_int best_sum[MAX_D + 1]; // Best sum for each d, from the solutions of all levels up to d
+    Solution* solutions;       // Best solution of each level, guarded by mutex
+    pthread_mutex_t mutex;
+} Sweep;
+
+// An input of a batch. Its frames are solved by the threads together with those of the other inputs.
+typedef struct Instance {
+    InputData input_data;
+    Batch* batch;              // Batch the instance belongs to
+    Ref_sumset* roots[2];      // Nodes of a_start and b_start
+    int root_depth;            // Total size of the starting multisets
+    atomic_int best_sum;       // Sum of the best solution found so far
+    Solution best_solution;    // Best solution, guarded by the batch's mutex
+    atomic_size_t pending;     // Frames pushed and not solved yet
+    bool finished;             // Set once no frame is pending, guarded by the batch's mutex
+} Instance;
+
+// Instances solved by one run of the search engine, in input order.
+struct Batch {
+    Instance** instances;
+    size_t count;
+    pthread_mutex_t mutex;     // Mutex protecting the solutions and finished flags of the instances
+    pthread_cond_t finished_cond; // Broadcast when an instance finishes
+};
 
 // Arguments passed to each thread.
 typedef struct {
     InputData* input_data;     // Input data shared among threads
     Solution* best_solution;   // Shared solution structure
-    WorkQueue* work_queue;     // Pointer to the global work queue
-    pthread_mutex_t* mutex;     // Mutex for thread-safe operations
+    Scheduler* scheduler;      // Pointer to the shared scheduler
+    pthread_mutex_t* mutex;    // Mutex for thread-safe operations
+    atomic_int* best_sum;      // Sum of the best solution found by any thread
+    const Options* options;    // Command line options
+    RefSumsetPool* pool;       // Pool owned by the thread
+    Worker* worker;            // State of the thread, readable by snapshots
+    int id;                    // Index of the thread and of its deque
+    Sweep* sweep;              // Sweep the search belongs to (or NULL)
+    double start_time;         // Start of the search, for the reports of new best solutions
+    struct Results* results;   // Solutions kept besides the best one (or NULL)
+    VisitedTable* visited;     // Pairs being or already expanded (or NULL)
 } ThreadArgs;
 
+// State of a single worker thread.
+struct Worker {
+    InputData* input_data;     // Input data shared among threads
+    Scheduler* scheduler;      // Pointer to the shared scheduler
+    atomic_int* best_sum;      // Sum of the best solution found by any thread
+    atomic_int* bound_sum;     // Sum a subtree must beat to be explored (best_sum, or that of results)
+    RefSumsetPool* pool;       // Thread's own memory pool
+    Solution best_solution;    // Best solution found by this thread
+    Stats* stats;              // Thread's own statistics, kept by the scheduler
+    GrainController grain;     // Decides between private and published subtrees
+    bool prune;                // Cut subtrees that cannot beat the best solution
+    bool delta;                // Push delta frames, see StackFrame
+    ChildOrder order;          // Order of the children, see common/child_order.h
+    bool donate;               // Donate siblings to idle threads, see solve_recursive_ordered
+    int words;                 // Width of the private searches, see common/sumset_fixed.h (0 for the generic one)
+    ChildScores scores;        // Solutions closed by each element, for the learned order
+    Sweep* sweep;              // Sweep the search belongs to (or NULL)
+    size_t memory_budget;      // Bytes this thread's frontier may take (0 for no limit)
+    double throttled_since;    // Start of the current throttled period (or 0)
+    int id;                    // Index of the thread and of its deque
+    bool anytime;              // Report each new best solution on stderr, see report_best
+    double start_time;         // Start of the search
+    Instance* instance;        // Instance of the frame being solved, in batch mode (or NULL)
+    StackFrame current;        // Frame being solved (or NULLs), saved whole by snapshots
+    StackFrame best;           // Nodes of best_solution, kept alive for snapshots
+    struct Results* results;   // Solutions kept besides the best one (or NULL)
+    ResultHeap heap;           // The thread's part of them
+    VisitedTable* visited;     // Pairs being or already expanded (or NULL)
+    int visited_size;          // Largest total size of the pairs looked up in visited
+    const Ref_sumset* visited_roots[2]; // Roots whose hashes are cached, see root_hash
+    uint64_t visited_root_hashes[2];
+};
+
+/*
+ * Solutions kept besides the best one, with --top or --all-optimal (see common/results.h).
+ * Each thread collects its own and merges them here when it finishes.
+ */
+typedef struct Results {
+    ResultHeap merged;         // Results of the threads that finished
+    FILE* spill;               // Optimal results flushed by the threads (or NULL)
+    atomic_int bound_sum;      // Largest bound of the threads' heaps, see result_heap_bound
+    pthread_mutex_t mutex;     // Protects merged and spill
+    size_t written;            // Number of results written at the end
+} Results;
+
+// State of the snapshots, used by the main thread.
+typedef struct {
+    Ref_sumset* roots[2];      // Nodes of a_start and b_start
+    Worker* workers;
+    StackFrame best;           // Nodes of the best solution of the resumed snapshot (or NULLs)
+    int best_sum;
+    size_t snapshots;          // Number of snapshots written
+    double longest_pause;      // Longest time the threads were stopped, in seconds
+} Checkpoint;
+
+// A run of the search engine: the worker threads and the state they share.
+typedef struct {
+    InputData* input_data;
+    const Options* options;
+    Scheduler scheduler;
+    RefSumsetPool* pools;      // One pool per thread, outliving the threads
+    Worker* workers;
+    pthread_t* threads;
+    ThreadArgs* thread_args;
+    Checkpoint checkpoint;     // Roots and best solution, for snapshots
+    Solution best_solution;    // Best solution, merged from the threads as they finish
+    atomic_int best_sum;       // Sum of the best solution found by any thread
+    pthread_mutex_t solution_mutex;
+    pthread_t dump_thread;     // Prints the statistics on SIGUSR1
+    atomic_bool joined;        // Set once the threads have finished, ends dump_thread
+    double start_time;
+    Batch* batch;              // Instances to solve instead of input_data (or NULL)
+    Sweep* sweep;              // Solutions to keep by level, for a sweep over d (or NULL)
+    const char* stop_reason;   // Limit that stopped the search (or NULL)
+    StackFrame* frontier;      // Frames collected when a limit stopped the search, for the final snapshot
+    size_t frontier_count;
+    size_t partition_tasks;    // Number of tasks of the static partition
+    double partition_nodes;    // Their estimated number of nodes in total
+    double partition_largest;  // Estimated number of nodes of the largest one
+    Topology topology;         // CPUs the threads are pinned to (read only with options->affinity)
+    Results* results;          // Solutions kept besides the best one (or NULL)
+    VisitedTable visited;      // Pairs being or already expanded (allocated only with options->visited_bytes)
+} Search;
+
+// Frames of the top levels of the tree, expanded breadth first from the frames added.
+typedef struct {
+    InputData* input_data;
+    bool prune;                // Cut subtrees that cannot beat the checkpoint's best solution
+    RefSumsetPool* pool;       // Pool of the new nodes
+    Checkpoint* checkpoint;    // Roots and nodes of the best solution found on the way
+    Solution* best_solution;   // Best solution found on the way
+    StackFrame* frames;        // Frames of the deepest level
+    size_t frames_count;
+    size_t frames_capacity;
+} Prefix;
+
+// A task of the static partition.
+typedef struct {
+    StackFrame frame;
+    double cost;               // Estimated number of nodes of its subtree
+    size_t index;              // Position in the expansion, breaks ties
+} PartitionTask;
+
 
 /*
  * Functions for memory pool management.
@@ -71,29 +422,54 @@ typedef struct {
 void pool_init(RefSumsetPool* pool) {
     pool->free_list = NULL;
     pool->pool_blocks = NULL;
+    pool->in_use = 0;
+    pool->high_water = 0;
+    atomic_init(&pool->blocks, 0);
+    pool->remote_frees = 0;
+    atomic_init(&pool->remote_free, NULL);
 }
 
 // Allocate a new block of Ref_sumset structures
 void pool_allocate_block(RefSumsetPool* pool) {
-    Ref_sumset* block = malloc(sizeof(Ref_sumset) * POOL_BLOCK_SIZE);
+    PoolBlock* block = malloc(sizeof(PoolBlock));
 
     if (!block) {
         exit(ERROR);
     }
 
     // Add the block to the pool blocks list
-    block->next = (Ref_sumset*)pool->pool_blocks;
+    block->next = pool->pool_blocks;
     pool->pool_blocks = block;
+    counter_add(&pool->blocks, 1);
 
     // Add all nodes in the block to the free list
     for (int i = 0; i < POOL_BLOCK_SIZE; i++) {
-        block[i].next = pool->free_list;
-        pool->free_list = &block[i];
+        block->nodes[i].owner = pool;
+        block->nodes[i].next = pool->free_list;
+        pool->free_list = &block->nodes[i];
+    }
+}
+
+// Take back all nodes released by other threads.
+static void pool_drain_remote(RefSumsetPool* pool) {
+    Ref_sumset* node = atomic_exchange_explicit(&pool->remote_free, NULL, memory_order_acquire);
+
+    while (node) {
+        Ref_sumset* next = node->next;
+        node->next = pool->free_list;
+        pool->free_list = node;
+        pool->in_use--;
+        pool->remote_frees++;
+        node = next;
     }
 }
 
 // Allocate a Ref_sumset from the pool
 Ref_sumset* pool_allocate(RefSumsetPool* pool) {
+    if (!pool->free_list) {
+        pool_drain_remote(pool);
+    }
+
     if (!pool->free_list) {
         pool_allocate_block(pool); // Allocate a new block if free list is empty
     }
@@ -102,99 +478,349 @@ Ref_sumset* pool_allocate(RefSumsetPool* pool) {
     pool->free_list = node->next;
     node->next = NULL; // Clear the next pointer
 
+    if (++pool->in_use > pool->high_water) {
+        pool->high_water = pool->in_use;
+    }
+
     return node;
 }
 
-// Release a Ref_sumset back to the pool
+// Release a Ref_sumset back to its owner. pool is the pool of the calling thread (or NULL).
 void pool_release(RefSumsetPool* pool, Ref_sumset* node) {
-    node->next = pool->free_list;
-    pool->free_list = node;
+    RefSumsetPool* owner = node->owner;
+
+    if (owner == pool) {
+        node->next = pool->free_list;
+        pool->free_list = node;
+        pool->in_use--;
+        return;
+    }
+
+    // Push onto the owner's remote list. Only the owner pops, taking the whole list at once.
+    Ref_sumset* head = atomic_load_explicit(&owner->remote_free, memory_order_relaxed);
+    do {
+        node->next = head;
+    } while (!atomic_compare_exchange_weak_explicit(&owner->remote_free, &head, node,
+                                                    memory_order_release, memory_order_relaxed));
 }
 
-// Free all memory used by the pool
+// Free all memory used by the pool. No node of the pool may be in use by any thread.
 void pool_destroy(RefSumsetPool* pool) {
-    Ref_sumset* block = pool->pool_blocks;
+    PoolBlock* block = pool->pool_blocks;
 
     while (block) {
-        Ref_sumset* next_block = (Ref_sumset*)block->next;
+        PoolBlock* next_block = block->next;
         free(block);
         block = next_block;
     }
 
     pool->free_list = NULL;
     pool->pool_blocks = NULL;
+    atomic_store_explicit(&pool->remote_free, NULL, memory_order_relaxed);
 }
 
 
 /*
- * Functions for global stack management.
+ * Functions for work scheduling.
  */
 
-// Initialize the work queue.
-void work_queue_init(WorkQueue* queue, size_t capacity, int t) {
-    queue->frames = malloc(sizeof(StackFrame) * capacity);
-    queue->size = 0;
-    queue->capacity = capacity;
-    queue->working_counter = t;
+// Initialize the scheduler with one empty deque per thread.
+void scheduler_init(Scheduler* scheduler, int t) {
+    scheduler->deques = aligned_alloc(alignof(WorkDeque), sizeof(WorkDeque) * t);
+
+    if (!scheduler->deques) {
+        exit(ERROR);
+    }
+
+    for (int i = 0; i < t; ++i) {
+        deque_init(&scheduler->deques[i], DEQUE_CAPACITY);
+    }
+
+    scheduler->stats = aligned_alloc(alignof(Stats), sizeof(Stats) * t);
+
+    if (!scheduler->stats) {
+        exit(ERROR);
+    }
+
+    memset(scheduler->stats, 0, sizeof(Stats) * t);
+
+    scheduler->t = t;
+    atomic_init(&scheduler->idle_counter, 0);
+    atomic_init(&scheduler->done, false);
+    atomic_init(&scheduler->sleepers, 0);
+
+    atomic_init(&scheduler->pause, false);
+    atomic_init(&scheduler->stopped, false);
+    scheduler->paused = 0;
+    scheduler->finish_fd = -1;
+    scheduler->tasks = NULL;
+    scheduler->tasks_count = 0;
+    atomic_init(&scheduler->next_task, 0);
+    scheduler->nodes = NULL;
+    scheduler->local_steals = false;
+
+    ASSERT_ZERO(pthread_mutex_init(&scheduler->mutex, NULL));
+    ASSERT_ZERO(pthread_cond_init(&scheduler->cond, NULL));
+    ASSERT_ZERO(pthread_cond_init(&scheduler->resume_cond, NULL));
+
+    // The snapshot timer waits on paused_cond, against the monotonic clock.
+    pthread_condattr_t attr;
+    ASSERT_ZERO(pthread_condattr_init(&attr));
+    ASSERT_ZERO(pthread_condattr_setclock(&attr, CLOCK_MONOTONIC));
+    ASSERT_ZERO(pthread_cond_init(&scheduler->paused_cond, &attr));
+    ASSERT_ZERO(pthread_condattr_destroy(&attr));
+}
 
-    ASSERT_ZERO(pthread_mutex_init(&queue->mutex, NULL));
-    ASSERT_ZERO(pthread_cond_init(&queue->cond, NULL));
+// Free the deques and synchronization primitives.
+void scheduler_destroy(Scheduler* scheduler) {
+    for (int i = 0; i < scheduler->t; ++i) {
+        deque_destroy(&scheduler->deques[i]);
+    }
+    free(scheduler->deques);
+    free(scheduler->stats);
+    free(scheduler->tasks);
+    free(scheduler->nodes);
+
+    ASSERT_ZERO(pthread_mutex_destroy(&scheduler->mutex));
+    ASSERT_ZERO(pthread_cond_destroy(&scheduler->cond));
+    ASSERT_ZERO(pthread_cond_destroy(&scheduler->paused_cond));
+    ASSERT_ZERO(pthread_cond_destroy(&scheduler->resume_cond));
 }
 
-// Push a frame onto the work queue.
-void work_queue_push(WorkQueue* queue, StackFrame frame) {
-    ASSERT_ZERO(pthread_mutex_lock(&queue->mutex));
+// Push a frame onto the deque of thread id and wake a sleeping thread if there is one.
+void scheduler_push(Scheduler* scheduler, int id, StackFrame frame) {
+    deque_push(&scheduler->deques[id], frame);
+    COUNT(&scheduler->stats[id], pushes, 1);
+
+#if PARALLEL_COUNTERS
+    size_t frames = (size_t)deque_size(&scheduler->deques[id]);
+    if (frames > counter_get(&scheduler->stats[id].peak_frames)) {
+        atomic_store_explicit(&scheduler->stats[id].peak_frames, frames, memory_order_relaxed);
+    }
+#endif
 
-    // Resize the queue if necessary.
-    if (queue->size >= queue->capacity) {
-        queue->capacity *= 2;
-        queue->frames = realloc(queue->frames, sizeof(StackFrame) * queue->capacity);
+    // Pairs with the increment of sleepers in scheduler_sleep: either the sleeper
+    // sees the new frame, or we see the sleeper and wake it up.
+    atomic_thread_fence(memory_order_seq_cst);
 
-        if (!queue->frames) {
-            exit(ERROR);
+    if (atomic_load_explicit(&scheduler->sleepers, memory_order_relaxed) > 0) {
+        ASSERT_ZERO(pthread_mutex_lock(&scheduler->mutex));
+        ASSERT_ZERO(pthread_cond_signal(&scheduler->cond));
+        ASSERT_ZERO(pthread_mutex_unlock(&scheduler->mutex));
+    }
+}
+
+// Check whether any deque holds a frame.
+static bool scheduler_has_work(Scheduler* scheduler) {
+    for (int i = 0; i < scheduler->t; ++i) {
+        if (deque_size(&scheduler->deques[i]) > 0) {
+            return true;
         }
     }
-    queue->frames[queue->size++] = frame;
 
-    ASSERT_ZERO(pthread_cond_signal(&queue->cond));
-    ASSERT_ZERO(pthread_mutex_unlock(&queue->mutex));
+    return false;
 }
 
-// Pop a frame from the work queue.
-int work_queue_pop(WorkQueue* queue, StackFrame* frame) {
-    ASSERT_ZERO(pthread_mutex_lock(&queue->mutex));
+// Mark the computation as finished and wake up all sleeping threads.
+static void scheduler_finish(Scheduler* scheduler) {
+    ASSERT_ZERO(pthread_mutex_lock(&scheduler->mutex));
 
-    // If the queue is empty, decrease the working counter and wait for a task to be added.
-    if (queue->size == 0) {
-        queue->working_counter--;
+    atomic_store(&scheduler->done, true);
 
-        while (queue->size == 0 && queue->working_counter > 0) {
-            // Wait for a task to be added or for all threads to stop working.
-            ASSERT_ZERO(pthread_cond_wait(&queue->cond, &queue->mutex));
-        }
+    ASSERT_ZERO(pthread_cond_broadcast(&scheduler->cond));
+    ASSERT_ZERO(pthread_cond_broadcast(&scheduler->paused_cond));
+    ASSERT_ZERO(pthread_mutex_unlock(&scheduler->mutex));
 
-        queue->working_counter++;
+    if (scheduler->finish_fd >= 0) {
+        char byte = 0;
+        ASSERT_SYS_OK(write(scheduler->finish_fd, &byte, 1));
     }
+}
 
-    if (queue->size == 0) { // No more tasks and no working threads.
-        ASSERT_ZERO(pthread_mutex_unlock(&queue->mutex));
-        return 0;
+// Block until some deque is not empty or the computation is finished.
+static void scheduler_sleep(Scheduler* scheduler, int id) {
+#if PARALLEL_COUNTERS
+    double start = now();
+#endif
+    ASSERT_ZERO(pthread_mutex_lock(&scheduler->mutex));
+
+    atomic_fetch_add(&scheduler->sleepers, 1);
+    // A snapshot in scheduler_stop counts the sleepers as stopped threads.
+    ASSERT_ZERO(pthread_cond_broadcast(&scheduler->paused_cond));
+
+    while (!atomic_load(&scheduler->done) && !scheduler_has_work(scheduler)) {
+        ASSERT_ZERO(pthread_cond_wait(&scheduler->cond, &scheduler->mutex));
+    }
+
+    atomic_fetch_sub(&scheduler->sleepers, 1);
+
+    ASSERT_ZERO(pthread_mutex_unlock(&scheduler->mutex));
+
+    COUNT(&scheduler->stats[id], waits, 1);
+    COUNT(&scheduler->stats[id], wait_ns, (size_t)((now() - start) * 1e9));
+}
+
+/*
+ * Stop at a pause point until the snapshot in progress has captured the frontier.
+ * Returns false if the search has been stopped for good.
+ */
+static bool scheduler_wait_resume(Scheduler* scheduler) {
+    if (atomic_load(&scheduler->stopped)) {
+        return false;
+    }
+
+    ASSERT_ZERO(pthread_mutex_lock(&scheduler->mutex));
+
+    scheduler->paused++;
+    ASSERT_ZERO(pthread_cond_broadcast(&scheduler->paused_cond));
+
+    while (atomic_load(&scheduler->pause) && !atomic_load(&scheduler->stopped)) {
+        ASSERT_ZERO(pthread_cond_wait(&scheduler->resume_cond, &scheduler->mutex));
+    }
+
+    scheduler->paused--;
+
+    ASSERT_ZERO(pthread_mutex_unlock(&scheduler->mutex));
+
+    return !atomic_load(&scheduler->stopped);
+}
+
+/*
+ * A point where the thread may stop for a snapshot. At a pause point the thread's
+ * frames are all either on its deque or in its current frame. Returns false once the
+ * search has been stopped by a limit; the thread then drops the frame it is solving.
+ */
+static inline bool scheduler_pause_point(Scheduler* scheduler) {
+    if (atomic_load_explicit(&scheduler->pause, memory_order_relaxed)) {
+        return scheduler_wait_resume(scheduler);
+    }
+
+    return true;
+}
+
+/*
+ * Stop all threads at pause points or in their sleep. Returns with the mutex held,
+ * or false if the search finished first. Sleeping threads hold no frames, and
+ * cannot wake up while the mutex is held.
+ */
+static bool scheduler_stop(Scheduler* scheduler) {
+    ASSERT_ZERO(pthread_mutex_lock(&scheduler->mutex));
+
+    atomic_store(&scheduler->pause, true);
+
+    while (!atomic_load(&scheduler->done) &&
+           scheduler->paused + atomic_load(&scheduler->sleepers) < scheduler->t) {
+        ASSERT_ZERO(pthread_cond_wait(&scheduler->paused_cond, &scheduler->mutex));
     }
 
-    *frame = queue->frames[--queue->size];
-    ASSERT_ZERO(pthread_mutex_unlock(&queue->mutex));
+    if (atomic_load(&scheduler->done)) {
+        atomic_store(&scheduler->pause, false);
+        ASSERT_ZERO(pthread_cond_broadcast(&scheduler->resume_cond));
+        ASSERT_ZERO(pthread_mutex_unlock(&scheduler->mutex));
+        return false;
+    }
+
+    return true;
+}
+
+// Let the threads stopped by scheduler_stop continue.
+static void scheduler_resume(Scheduler* scheduler) {
+    atomic_store(&scheduler->pause, false);
 
-    return 1;
+    ASSERT_ZERO(pthread_cond_broadcast(&scheduler->resume_cond));
+    ASSERT_ZERO(pthread_mutex_unlock(&scheduler->mutex));
 }
 
-// Decrease the working counter and signal waiting threads.
-void working_decrease(WorkQueue* queue) {
-    ASSERT_ZERO(pthread_mutex_lock(&queue->mutex));
+/*
+ * End the search early, with the threads stopped by scheduler_stop. The pause flag stays
+ * set, so every pause point fails from now on: the threads drop their frames, release
+ * the frames left in their deques without solving them and finish.
+ */
+static void scheduler_abort(Scheduler* scheduler) {
+    atomic_store(&scheduler->stopped, true);
+    atomic_store(&scheduler->done, true);
+
+    ASSERT_ZERO(pthread_cond_broadcast(&scheduler->cond));
+    ASSERT_ZERO(pthread_cond_broadcast(&scheduler->resume_cond));
+    ASSERT_ZERO(pthread_mutex_unlock(&scheduler->mutex));
+}
+
+/*
+ * Get the next frame for thread id: from its own deque, the next task of the static
+ * partition, or stolen from another thread. Returns POP_NONE when there is no more work.
+ *
+ * A thread counts itself as idle while it holds no frame. A thread becomes idle only
+ * after its own deque turned out empty and the tasks ran out, and only the owner pushes
+ * onto a deque, so once all threads are idle every deque is empty and the search is finished.
+ *
+ * With local steals, each round first tries the threads on the thief's NUMA node and only
+ * then the others, so that frames (and the nodes they point to) mostly stay on their node.
+ */
+PopResult scheduler_pop(Scheduler* scheduler, int id, StackFrame* frame) {
+    if (deque_take(&scheduler->deques[id], frame)) {
+        COUNT(&scheduler->stats[id], pops, 1);
+        return POP_OWN;
+    }
+
+    if (scheduler->tasks) {
+        size_t k = atomic_fetch_add_explicit(&scheduler->next_task, 1, memory_order_relaxed);
+
+        if (k < scheduler->tasks_count) {
+            *frame = scheduler->tasks[k];
+            return POP_TASK;
+        }
+    }
+
+    int t = scheduler->t;
+    if (atomic_fetch_add(&scheduler->idle_counter, 1) + 1 == t) {
+        scheduler_finish(scheduler);
+        return POP_NONE;
+    }
+
+    unsigned int seed = id;
+    int failed_rounds = 0;
+
+    while (!atomic_load(&scheduler->done)) {
+        scheduler_pause_point(scheduler);
 
-    queue->working_counter--;
+        int start = rand_r(&seed) % t;
 
-    ASSERT_ZERO(pthread_cond_signal(&queue->cond));
-    ASSERT_ZERO(pthread_mutex_unlock(&queue->mutex));
+        // Pass 0 tries the thief's own node only, pass 1 the rest (or everyone without local steals).
+        for (int pass = scheduler->local_steals ? 0 : 1; pass < 2; ++pass) {
+            for (int k = 0; k < t; ++k) {
+                int victim = (start + k) % t;
+                bool local = scheduler->nodes && scheduler->nodes[victim] == scheduler->nodes[id];
+
+                if (victim == id || deque_size(&scheduler->deques[victim]) == 0 ||
+                    (pass == 0 && !local) || (pass == 1 && scheduler->local_steals && local)) {
+                    continue;
+                }
+
+                atomic_fetch_sub(&scheduler->idle_counter, 1);
+
+                if (deque_steal(&scheduler->deques[victim], frame)) {
+                    COUNT(&scheduler->stats[id], steals, 1);
+                    COUNT(&scheduler->stats[id], remote_steals, scheduler->nodes && !local);
+                    return POP_STOLEN;
+                }
+                COUNT(&scheduler->stats[id], failed_steals, 1);
+
+                if (atomic_fetch_add(&scheduler->idle_counter, 1) + 1 == t) {
+                    scheduler_finish(scheduler);
+                    return POP_NONE;
+                }
+            }
+        }
+
+        if (++failed_rounds < STEAL_ROUNDS) {
+            sched_yield();
+        } else {
+            scheduler_sleep(scheduler, id);
+            failed_rounds = 0;
+        }
+    }
+
+    return POP_NONE;
 }
 
 
@@ -224,171 +850,3017 @@ void sumset_release(RefSumsetPool* pool, Ref_sumset* sumset) {
     }
 }
 
+// Create the node a + i, taking over a reference to a held by the caller.
+static inline Ref_sumset* sumset_adopt(RefSumsetPool* pool, Ref_sumset* a, int i) {
+    Ref_sumset* new_node = pool_allocate(pool);
+
+    sumset_add(&new_node->this_sumset, &a->this_sumset, i);
+
+    new_node->mask = sumset_mask_add(a->mask, i);
+    new_node->parent = a;
+    new_node->instance = a->instance;
+    atomic_store_explicit(&new_node->ref_count, 1, memory_order_relaxed); // Not shared yet.
+    new_node->size = a->size + 1;
+
+    return new_node;
+}
+
+// Create the node a + i, holding a reference to a.
+static inline Ref_sumset* sumset_extend(RefSumsetPool* pool, Ref_sumset* a, int i) {
+    sumset_retain(a);
+    return sumset_adopt(pool, a, i);
+}
+
+
 /*
- * Iterative solution.
- * This function is used when the work queue isn't big enough.
+ * Functions for task granularity control.
  */
-void solve_iteratively(Ref_sumset* a, Ref_sumset* b, InputData* input_data, Solution* best_solution, RefSumsetPool* pool, WorkQueue *work_queue) {
-    if (a->this_sumset.sum > b->this_sumset.sum) {
-        Ref_sumset *temp = a;
-        a = b;
-        b = temp;
+
+// Allocate the cost estimates for inputs with the given d.
+static void grain_init_costs(GrainController* grain, int d) {
+    grain->d = d;
+    grain->cost = malloc(sizeof(double) * (d + 1) * (d + 1));
+
+    if (!grain->cost) {
+        exit(ERROR);
     }
 
-    // Check the intersection of A^\u03A3 and B^\u03A3.
-    if (is_sumset_intersection_trivial(&a->this_sumset, &b->this_sumset)) {
-        for (int i = a->this_sumset.last; i <= input_data->d; ++i) {
-            if (!does_sumset_contain(&b->this_sumset, i)) {
-                Ref_sumset* new_node = pool_allocate(pool);
+    // Until measured, assume the subtree doubles with every possible extension.
+    for (int r = 0; r <= d; ++r) {
+        for (int h = 0; h <= d; ++h) {
+            grain->cost[r * (d + 1) + h] = ldexp(1.0, r < 60 ? r : 60);
+        }
+    }
+}
 
-                sumset_add(&new_node->this_sumset, &a->this_sumset, i);
+// Initialize the controller of a thread.
+void grain_init(GrainController* grain, const Options* options, InputData* input_data) {
+    int d = input_data->d;
 
-                new_node->parent = a;
-                new_node->ref_count = 1;
+    grain->policy = options->grain;
+    grain->cutoff = options->cutoff;
+    grain->decisions = 0;
+    grain->root_depth = sumset_size_lower_bound(&input_data->a_start, d) +
+                        sumset_size_lower_bound(&input_data->b_start, d);
+    grain_init_costs(grain, d);
+}
 
-                sumset_retain(a);
-                sumset_retain(b);
+// Switch the controller to an instance of a batch. Costs are kept across instances with the same d.
+static void grain_switch(GrainController* grain, const Instance* instance) {
+    grain->root_depth = instance->root_depth;
 
-                work_queue_push(work_queue, (StackFrame){new_node, b});
-            }
-        }
-    } else if ((a->this_sumset.sum == b->this_sumset.sum) && (get_sumset_intersection_size(&a->this_sumset, &b->this_sumset) == 2)) {
-        if (b->this_sumset.sum > best_solution->sum) {
-            solution_build(best_solution, input_data, &a->this_sumset, &b->this_sumset);
-        }
+    if (instance->input_data.d != grain->d) {
+        free(grain->cost);
+        grain_init_costs(grain, instance->input_data.d);
+    }
+}
+
+void grain_destroy(GrainController* grain) {
+    free(grain->cost);
+}
+
+// Bucket of the subtree rooted at a pair whose smaller multiset is a.
+static inline int grain_bucket(const GrainController* grain, const Ref_sumset* a) {
+    int d = grain->d;
+    int remaining = d - a->this_sumset.last;
+    // Bound on the smaller sum of any expanded pair, see common/bound.h.
+    int headroom = (d * (d - 1) - a->this_sumset.sum) / d;
+
+    remaining = remaining < 0 ? 0 : (remaining > d ? d : remaining);
+    headroom = headroom < 0 ? 0 : (headroom > d ? d : headroom);
+
+    return remaining * (d + 1) + headroom;
+}
+
+// Adapt the cutoff: publish more while other threads starve, less while work is plentiful.
+static void grain_adjust(GrainController* grain, Scheduler* scheduler, int id, bool stolen) {
+    if (stolen) {
+        grain->cutoff = fmax(grain->cutoff / 2, GRAIN_MIN_CUTOFF);
+    }
+
+    if (++grain->decisions < GRAIN_WINDOW) {
+        return;
+    }
+    grain->decisions = 0;
+
+    if (atomic_load_explicit(&scheduler->idle_counter, memory_order_relaxed) > 0) {
+        grain->cutoff = fmax(grain->cutoff / 2, GRAIN_MIN_CUTOFF);
+    } else if (deque_size(&scheduler->deques[id]) > GRAIN_SURPLUS) {
+        grain->cutoff = fmin(grain->cutoff * 2, GRAIN_MAX_CUTOFF);
     }
 }
 
+// Decide whether to solve the subtree of a frame privately. a is the multiset with the smaller sum.
+static bool grain_is_private(GrainController* grain, Scheduler* scheduler, int id, bool stolen,
+                             const Ref_sumset* a, int depth) {
+    switch (grain->policy) {
+        case GRAIN_QUEUE:
+            return deque_size(&scheduler->deques[id]) >= 2;
+        case GRAIN_ADAPTIVE:
+            grain_adjust(grain, scheduler, id, stolen);
+            break;
+        case GRAIN_STATIC:
+            break;
+    }
+
+    // Shallow frames are always published, so that every thread gets work early on.
+    if (depth - grain->root_depth < 2) {
+        return false;
+    }
+
+    return grain->cost[grain_bucket(grain, a)] <= grain->cutoff;
+}
+
+// Learn the measured size of a subtree solved privately.
+static void grain_learn(GrainController* grain, const Ref_sumset* a, size_t nodes) {
+    double* cost = &grain->cost[grain_bucket(grain, a)];
+    *cost = 0.75 * *cost + 0.25 * (double)nodes;
+}
+
+
+/*
+ * Functions for the search.
+ */
+
+// Level of a pair with the given last elements. Elements are added in nondecreasing order.
+static inline int sweep_level(const Sweep* sweep, int a_last, int b_last) {
+    int level = a_last > b_last ? a_last : b_last;
+    return level > sweep->first ? level : sweep->first;
+}
+
 /*
- * Recursive solution.
- * This function is used when the work queue is big enough.
+ * Check whether no solution extending a pair of the given level can beat the best one for
+ * any d it belongs to. The bound for d only grows with d, so the loop usually stops at once.
  */
-void solve_recursive(const Sumset* a, const Sumset* b, InputData* input_data, Solution* best_solution) {
-    if (a->sum > b->sum)
-        return solve_recursive(b, a, input_data, best_solution);
+static bool sweep_can_prune(const Sweep* sweep, int level, int a_sum, int a_size, int b_sum, int b_size) {
+    for (int d = level; d <= sweep->last; ++d) {
+        if (solution_upper_bound(a_sum, a_size, b_sum, b_size, d) >
+            atomic_load_explicit(&sweep->best_sum[d], memory_order_relaxed)) {
+            return false;
+        }
+    }
+
+    return true;
+}
 
-    if (is_sumset_intersection_trivial(a, b)) { // s(a) ∩ s(b) = {0}.
-        for (int i = a->last; i <= input_data->d; ++i) {
-            if (!does_sumset_contain(b, i)) {
-                Sumset a_with_i;
-                sumset_add(&a_with_i, a, i);
-                solve_recursive(&a_with_i, b, input_data, best_solution);
+// Record a solution of a sweep as one for every d from its level on.
+static void sweep_record(Sweep* sweep, InputData* input_data, const Sumset* a, const Sumset* b) {
+    int level = sweep_level(sweep, a->last, b->last);
+    ASSERT_ZERO(pthread_mutex_lock(&sweep->mutex));
+
+    if (b->sum > sweep->solutions[level].sum) {
+        solution_build(&sweep->solutions[level], input_data, a, b);
+
+        for (int d = level; d <= sweep->last; ++d) {
+            if (b->sum > atomic_load_explicit(&sweep->best_sum[d], memory_order_relaxed)) {
+                atomic_store_explicit(&sweep->best_sum[d], b->sum, memory_order_relaxed);
             }
         }
-    } else if ((a->sum == b->sum) && (get_sumset_intersection_size(a, b) == 2)) { // s(a) ∩ s(b) = {0, ∑b}.
-        if (b->sum > best_solution->sum)
-            solution_build(best_solution, input_data, a, b);
     }
+
+    ASSERT_ZERO(pthread_mutex_unlock(&sweep->mutex));
 }
 
 /*
- * Worker thread function.
+ * Check whether no solution extending multisets with the given sums, sizes and last
+ * elements can beat the best one.
  */
-void* worker_thread(void* arg) {
-    // Get the thread arguments.
-    ThreadArgs* args = (ThreadArgs*)arg;
-    InputData* input_data = args->input_data;
-    WorkQueue* global_work_queue = args->work_queue;
-    pthread_mutex_t* solution_mutex = args->mutex;
-
-    // Initialize local variables.
-    Solution best_solution;
-    solution_init(&best_solution);
+static inline bool can_prune(Worker* worker, int a_sum, int a_size, int a_last, int b_sum, int b_size, int b_last) {
+    if (!worker->prune) {
+        return false;
+    }
 
-    StackFrame frame;
-    Ref_sumset *a, *b;
+    if (worker->sweep) {
+        return sweep_can_prune(worker->sweep, sweep_level(worker->sweep, a_last, b_last), a_sum, a_size, b_sum, b_size);
+    }
 
-    RefSumsetPool pool;
-    pool_init(&pool);
+    return solution_upper_bound(a_sum, a_size, b_sum, b_size, worker->input_data->d) <=
+           atomic_load_explicit(worker->bound_sum, memory_order_relaxed);
+}
 
-    while(true) {
-        if (!work_queue_pop(global_work_queue, &frame)) {
-            break; // No more tasks.
-        }
+// Record a solution of a batch's instance straight into the instance.
+static void instance_record(Instance* instance, const Sumset* a, const Sumset* b) {
+    Batch* batch = instance->batch;
+    ASSERT_ZERO(pthread_mutex_lock(&batch->mutex));
 
-        a = frame.b;
-        b = frame.a;
+    if (b->sum > instance->best_solution.sum) {
+        solution_build(&instance->best_solution, &instance->input_data, a, b);
+        atomic_store_explicit(&instance->best_sum, b->sum, memory_order_relaxed);
+    }
 
-        // Solve the task iteratively or recursively, depending on the size of the work queue.
-        if (global_work_queue->size < 2 * input_data->t) {
-            solve_iteratively(a, b, input_data, &best_solution, &pool, global_work_queue);
-        } else {
-            solve_recursive(&a->this_sumset, &b->this_sumset, input_data, &best_solution);
-        }
+    ASSERT_ZERO(pthread_mutex_unlock(&batch->mutex));
+}
 
-        // Release the sumsets taken from the stack.
-        sumset_release(&pool, a);
-        sumset_release(&pool, b);
+// Count a solved frame of the instance, finishing the instance after its last one.
+static void instance_frame_done(Instance* instance) {
+    if (atomic_fetch_sub(&instance->pending, 1) != 1) {
+        return;
     }
 
-    // Update the global best solution.
-    ASSERT_ZERO(pthread_mutex_lock(solution_mutex));
+    Batch* batch = instance->batch;
+    ASSERT_ZERO(pthread_mutex_lock(&batch->mutex));
+    instance->finished = true;
+    ASSERT_ZERO(pthread_cond_broadcast(&batch->finished_cond));
+    ASSERT_ZERO(pthread_mutex_unlock(&batch->mutex));
+}
 
-    if (best_solution.sum > args->best_solution->sum) {
-        *args->best_solution = best_solution;
+/*
+ * Report a new best sum on stderr. A sum already beaten by another thread is not
+ * reported, so the reports increase.
+ */
+static void report_best(Worker* worker, int sum) {
+    flockfile(stderr);
+
+    if (atomic_load_explicit(worker->best_sum, memory_order_relaxed) == sum) {
+        fprintf(stderr, "best %d after %.3f s\n", sum, now() - worker->start_time);
     }
 
-    ASSERT_ZERO(pthread_mutex_unlock(solution_mutex));
+    funlockfile(stderr);
+}
 
-    // Clean up resources.
-    working_decrease(global_work_queue);
-    pool_destroy(&pool);
+/*
+ * Add a solution to the thread's results and publish their bound to the other threads.
+ * Optimal results are flushed to the spill file when the thread's heap is full.
+ */
+static void results_record(Worker* worker, const Sumset* a, const Sumset* b) {
+    Results* results = worker->results;
 
-    return 0;
+    if (!result_heap_may_take(&worker->heap, b->sum)) {
+        return;
+    }
+
+    if (result_heap_add(&worker->heap, a, b)) {
+        ASSERT_ZERO(pthread_mutex_lock(&results->mutex));
+        result_heap_flush(&worker->heap, results->spill);
+        ASSERT_ZERO(pthread_mutex_unlock(&results->mutex));
+    }
+
+    int bound = result_heap_bound(&worker->heap);
+    int bound_sum = atomic_load_explicit(&results->bound_sum, memory_order_relaxed);
+    while (bound_sum < bound &&
+           !atomic_compare_exchange_weak_explicit(&results->bound_sum, &bound_sum, bound,
+                                                  memory_order_relaxed, memory_order_relaxed)) {
+    }
 }
 
-// Main function.
-int main() {
-    InputData input_data;
-    input_data_read(&input_data);
+/*
+ * Record a solution and publish its sum to the other threads. Returns whether it is the
+ * thread's best. Solutions of a batch's instances go to the instance, and those of a sweep
+ * to the sweep; then false is returned. With results, the solution also goes to them.
+ */
+static bool record_solution(Worker* worker, const Sumset* a, const Sumset* b) {
+    if (worker->instance) {
+        instance_record(worker->instance, a, b);
+        return false;
+    }
 
-    Solution best_solution;
-    solution_init(&best_solution);
+    if (worker->sweep) {
+        sweep_record(worker->sweep, worker->input_data, a, b);
+        return false;
+    }
 
-    // Initialize the work queue.
-    WorkQueue work_queue;
-    work_queue_init(&work_queue, 1000, input_data.t);
+    if (worker->results) {
+        results_record(worker, a, b);
+    }
 
-    // Create initial tasks.
-    Ref_sumset* a_beg = malloc(sizeof(Ref_sumset));
-    Ref_sumset* b_beg = malloc(sizeof(Ref_sumset));
+    if (b->sum <= worker->best_solution.sum) {
+        return false;
+    }
 
-    a_beg->this_sumset = input_data.a_start;
-    b_beg->this_sumset = input_data.b_start;
-    a_beg->ref_count = 2;
-    b_beg->ref_count = 2;
-    a_beg->parent = NULL;
-    b_beg->parent = NULL;
-    work_queue_push(&work_queue, (StackFrame){a_beg, b_beg});
+    solution_build(&worker->best_solution, worker->input_data, a, b);
 
-    // Create a mutex for solution.
-    pthread_mutex_t solution_mutex;
-    ASSERT_ZERO(pthread_mutex_init(&solution_mutex, NULL));
+    int best_sum = atomic_load_explicit(worker->best_sum, memory_order_relaxed);
+    while (best_sum < b->sum &&
+           !atomic_compare_exchange_weak_explicit(worker->best_sum, &best_sum, b->sum,
+                                                  memory_order_relaxed, memory_order_relaxed)) {
+    }
+
+    if (worker->anytime && best_sum < b->sum) {
+        report_best(worker, b->sum);
+    }
 
-    // Create and start worker threads.
-    pthread_t threads[input_data.t];
-    ThreadArgs thread_args = {&input_data, &best_solution, &work_queue, &solution_mutex};
+    return true;
+}
 
-    for (size_t i = 0; i < input_data.t; ++i) {
-        ASSERT_ZERO(pthread_create(&threads[i], NULL, worker_thread, &thread_args));
+// Check whether record_solution may keep a solution with the given sum.
+static inline bool may_record(Worker* worker, int sum) {
+    if (worker->instance) {
+        return sum > atomic_load_explicit(&worker->instance->best_sum, memory_order_relaxed);
     }
 
-    // Wait for all threads to finish.
-    for (size_t i = 0; i < input_data.t; ++i) {
-        ASSERT_ZERO(pthread_join(threads[i], NULL));
+    return worker->sweep || sum > worker->best_solution.sum ||
+           (worker->results && result_heap_may_take(&worker->heap, sum));
+}
+
+// Hash of a root: its sum, last element and subset sums, like snapshot_fingerprint. The last two roots are cached.
+static uint64_t root_hash(Worker* worker, const Ref_sumset* root) {
+    for (int k = 0; k < 2; ++k) {
+        if (worker->visited_roots[k] == root) {
+            return worker->visited_root_hashes[k];
+        }
     }
 
-    solution_print(&best_solution);
+    const Sumset* sumset = &root->this_sumset;
+    uint64_t hash = visited_hash_add(visited_hash_add(0, (int)sumset->sum), (int)sumset->last);
 
-    // Free the memory.
-    free(a_beg);
-    free(b_beg);
-    free(work_queue.frames);
+    for (size_t i = 0; i <= sumset->sum; ++i) {
+        if (does_sumset_contain(sumset, i)) {
+            hash = visited_hash_add(hash, (int)i);
+        }
+    }
+
+    worker->visited_roots[1] = worker->visited_roots[0];
+    worker->visited_root_hashes[1] = worker->visited_root_hashes[0];
+    worker->visited_roots[0] = root;
+    worker->visited_root_hashes[0] = hash;
+
+    return hash;
+}
+
+// Hash of a node's multiset, see paralell/visited.h: the elements added since its root, then the root.
+static uint64_t node_hash(Worker* worker, const Ref_sumset* node, uint64_t hash) {
+    for (; node->parent; node = node->parent) {
+        hash = visited_hash_add(hash, (int)node->this_sumset.last);
+    }
+
+    return visited_mix(hash ^ root_hash(worker, node));
+}
+
+// Hash of a path node's multiset: the elements added on the path, then those of the frame's node.
+static uint64_t path_hash(Worker* worker, const PathNode* node) {
+    uint64_t hash = 0;
+
+    for (; node->parent; node = node->parent) {
+        hash = visited_hash_add(hash, node->element);
+    }
+
+    return node_hash(worker, node->twin, hash);
+}
+
+/*
+ * Look up the pair of the given total size and key in the visited table, claiming it if
+ * it is not there. Returns true if the pair was there, and its subtree is to be skipped.
+ */
+static bool visited_skip(Worker* worker, int size, uint64_t key) {
+    switch (visited_claim(worker->visited, key, size - worker->grain.root_depth)) {
+        case VISITED_SEEN:
+            counter_add(&worker->stats->visited_seen, 1);
+            return true;
+        case VISITED_EVICTED:
+            counter_add(&worker->stats->visited_evicted, 1);
+            // fall through
+        case VISITED_CLAIMED:
+            counter_add(&worker->stats->visited_claimed, 1);
+            break;
+        case VISITED_DROPPED:
+            counter_add(&worker->stats->visited_dropped, 1);
+            break;
+    }
+
+    return false;
+}
+
+// Keep the nodes of the thread's best solution alive for the snapshots.
+static void keep_best(Worker* worker, Ref_sumset* a, Ref_sumset* b) {
+    sumset_retain(a);
+    sumset_retain(b);
+    sumset_release(worker->pool, worker->best.a);
+    sumset_release(worker->pool, worker->best.b);
+    worker->best = (StackFrame){a, b, 0};
+}
+
+// Bytes taken by the thread's part of the frontier: the frames in its deque and its nodes in use.
+static inline size_t frontier_bytes(Worker* worker) {
+    return (size_t)deque_size(&worker->scheduler->deques[worker->id]) * sizeof(DequeSlot) +
+           worker->pool->in_use * sizeof(Ref_sumset);
+}
+
+/*
+ * Check whether the thread's frontier is over its memory budget. A throttled thread
+ * publishes no frames and solves whole subtrees depth-first on its own stack.
+ */
+static bool is_throttled(Worker* worker) {
+    if (!worker->memory_budget) {
+        return false;
+    }
+
+    bool throttled = frontier_bytes(worker) >= worker->memory_budget;
+    if (throttled) {
+        pool_drain_remote(worker->pool); // Nodes released by other threads no longer count.
+        throttled = frontier_bytes(worker) >= worker->memory_budget;
+    }
+
+    if (throttled && !worker->throttled_since) {
+        worker->throttled_since = now();
+    } else if (!throttled && worker->throttled_since) {
+        counter_add(&worker->stats->throttled_ns, (size_t)((now() - worker->throttled_since) * 1e9));
+        worker->throttled_since = 0;
+    }
+
+    return throttled;
+}
+
+// Push the frame (a + i, b), as a delta frame or with the node a + i built now.
+static inline void push_child(Worker* worker, Ref_sumset* a, int i, Ref_sumset* b) {
+    sumset_retain(b);
+
+    if (worker->instance) {
+        atomic_fetch_add(&worker->instance->pending, 1);
+    }
+
+    if (worker->delta) {
+        sumset_retain(a);
+        scheduler_push(worker->scheduler, worker->id, (StackFrame){a, b, i});
+    } else {
+        scheduler_push(worker->scheduler, worker->id, (StackFrame){sumset_extend(worker->pool, a, i), b, 0});
+    }
+}
+
+/*
+ * Iterative solution, exploring the children in the given order.
+ * This function is used when the thread's deque isn't big enough.
+ */
+static inline __attribute__((always_inline))
+void solve_iteratively_ordered(Ref_sumset* a, Ref_sumset* b, Worker* worker, ChildOrder order) {
+    if (a->this_sumset.sum > b->this_sumset.sum) {
+        Ref_sumset *temp = a;
+        a = b;
+        b = temp;
+    }
+
+    // The best solution may have improved since the frame was pushed.
+    if (can_prune(worker, a->this_sumset.sum, a->size, a->this_sumset.last, b->this_sumset.sum, b->size,
+                  b->this_sumset.last)) {
+        counter_add(&worker->stats->pruned, 1);
+        return;
+    }
+
+    // Near the roots, a pair reached along another path is skipped.
+    if (a->size + b->size <= worker->visited_size &&
+        visited_skip(worker, a->size + b->size,
+                     visited_pair_key(node_hash(worker, a, 0), node_hash(worker, b, 0)))) {
+        return;
+    }
+    counter_add(&worker->stats->nodes, 1);
+
+    // Check the intersection of A^\u03A3 and B^\u03A3.
+    if (sumset_mask_may_be_trivial(a->mask, b->mask) &&
+        is_sumset_intersection_trivial(&a->this_sumset, &b->this_sumset)) {
+        SumsetMask extensions = sumset_mask_extensions(b->mask, a->this_sumset.last, worker->input_data->d);
+        ChildParent parent = {a->mask, b->mask, a->this_sumset.sum, b->this_sumset.sum, b->this_sumset.last,
+                              worker->input_data->d};
+        ChildIterator children;
+        int8_t buffer[64];
+        int i;
+
+        // Push the children in reverse, so that the thread's own pops take them in order.
+        child_iterator_init(&children, order, true, extensions, &parent, &worker->scores, buffer);
+
+        while (child_iterator_next(&children, &i)) {
+            if (can_prune(worker, a->this_sumset.sum + i, a->size + 1, i, b->this_sumset.sum, b->size,
+                          b->this_sumset.last)) {
+                counter_add(&worker->stats->pruned, 1);
+                continue;
+            }
+
+            push_child(worker, a, i, b);
+        }
+    } else if ((a->this_sumset.sum == b->this_sumset.sum) && (get_sumset_intersection_size(&a->this_sumset, &b->this_sumset) == 2)) {
+        child_scores_credit(&worker->scores, a->this_sumset.last, b->this_sumset.last);
+
+        if (record_solution(worker, &a->this_sumset, &b->this_sumset)) {
+            keep_best(worker, a, b);
+        }
+    }
+}
+
+// Iterative solution. The default order gets a copy of its own, in which the children come straight from the mask.
+SUMSET_DISPATCH
+void solve_iteratively(Ref_sumset* a, Ref_sumset* b, Worker* worker) {
+    if (worker->order == ORDER_DESCENDING) {
+        solve_iteratively_ordered(a, b, worker, ORDER_DESCENDING);
+    } else {
+        solve_iteratively_ordered(a, b, worker, worker->order);
+    }
+}
+
+// Check whether some thread is waiting for work.
+static inline bool is_anyone_idle(Worker* worker) {
+    return atomic_load_explicit(&worker->scheduler->idle_counter, memory_order_relaxed) > 0;
+}
+
+// Start a recursion path at a shared node, in the given width (0 for the generic search).
+static inline void path_init(PathNode* node, Ref_sumset* shared, int words) {
+    if (words) {
+        sumset_fixed_of(&node->fixed, &shared->this_sumset, words);
+    } else {
+        node->sumset = shared->this_sumset;
+        node->mask = shared->mask;
+    }
+    node->size = shared->size;
+    node->element = 0;
+    node->parent = NULL;
+    node->twin = shared;
+}
+
+// Get the shared twin of a path node, creating the twins of its ancestors on the way.
+static Ref_sumset* path_share(PathNode* node, RefSumsetPool* pool) {
+    if (!node->twin) {
+        node->twin = sumset_extend(pool, path_share(node->parent, pool), node->element);
+    }
+
+    return node->twin;
+}
+
+/*
+ * Publish the children of (a, b) not taken from siblings yet, so that idle threads can steal them.
+ * The sums and b's last element are passed, since a path node keeps them in its sumset's width.
+ */
+static void donate_siblings(PathNode* a, PathNode* b, int a_sum, int b_sum, int b_last, ChildIterator siblings,
+                            Worker* worker) {
+    Ref_sumset* shared_a = path_share(a, worker->pool);
+    Ref_sumset* shared_b = path_share(b, worker->pool);
+    int left[64];
+    int count = 0;
+
+    while (child_iterator_next(&siblings, &left[count])) {
+        ++count;
+    }
+
+    // In reverse, so that the thread's own pops take them in order.
+    while (count > 0) {
+        int i = left[--count];
+
+        if (can_prune(worker, a_sum + i, a->size + 1, i, b_sum, b->size, b_last)) {
+            continue;
+        }
+
+        push_child(worker, shared_a, i, shared_b);
+        counter_add(&worker->stats->donated, 1);
+    }
+}
+
+SUMSET_DISPATCH void solve_recursive_descending(PathNode* a, PathNode* b, Worker* worker);
+SUMSET_DISPATCH void solve_recursive_other(PathNode* a, PathNode* b, Worker* worker);
+SUMSET_DISPATCH void solve_recursive_descending_64(PathNode* a, PathNode* b, Worker* worker);
+SUMSET_DISPATCH void solve_recursive_other_64(PathNode* a, PathNode* b, Worker* worker);
+SUMSET_DISPATCH void solve_recursive_descending_128(PathNode* a, PathNode* b, Worker* worker);
+SUMSET_DISPATCH void solve_recursive_other_128(PathNode* a, PathNode* b, Worker* worker);
+SUMSET_DISPATCH void solve_recursive_descending_256(PathNode* a, PathNode* b, Worker* worker);
+SUMSET_DISPATCH void solve_recursive_other_256(PathNode* a, PathNode* b, Worker* worker);
+SUMSET_DISPATCH void solve_recursive_descending_512(PathNode* a, PathNode* b, Worker* worker);
+SUMSET_DISPATCH void solve_recursive_other_512(PathNode* a, PathNode* b, Worker* worker);
+
+/*
+ * Recursive solution in the given order and width, by the instance compiled for them.
+ * The instances pass a constant width, so this folds into a single call there.
+ */
+static inline __attribute__((always_inline))
+void solve_recursive_call(PathNode* a, PathNode* b, Worker* worker, ChildOrder order, int words) {
+    if (order == ORDER_DESCENDING) {
+        switch (words) {
+            case 0:
+                solve_recursive_descending(a, b, worker);
+                break;
+            case 1:
+                solve_recursive_descending_64(a, b, worker);
+                break;
+            case 2:
+                solve_recursive_descending_128(a, b, worker);
+                break;
+            case 4:
+                solve_recursive_descending_256(a, b, worker);
+                break;
+            default:
+                solve_recursive_descending_512(a, b, worker);
+                break;
+        }
+    } else {
+        switch (words) {
+            case 0:
+                solve_recursive_other(a, b, worker);
+                break;
+            case 1:
+                solve_recursive_other_64(a, b, worker);
+                break;
+            case 2:
+                solve_recursive_other_128(a, b, worker);
+                break;
+            case 4:
+                solve_recursive_other_256(a, b, worker);
+                break;
+            default:
+                solve_recursive_other_512(a, b, worker);
+                break;
+        }
+    }
+}
+
+/*
+ * Recursive solution, exploring the children in the given order, on fixed sumsets of
+ * the given number of words or, if it is 0, on the generic ones (see common/sumset_fixed.h).
+ * The fixed path nodes hold no Sumset; the shared twins needed by a donation or a
+ * solution are built from the frame's nodes by path_share.
+ * This function is used when the thread's deque is big enough.
+ * While other threads are idle, the unexplored siblings are donated to them (except in a static partition).
+ */
+static inline __attribute__((always_inline))
+void solve_recursive_ordered(PathNode* a, PathNode* b, Worker* worker, ChildOrder order, int words) {
+    if ((words ? a->fixed.sum : a->sumset.sum) > (words ? b->fixed.sum : b->sumset.sum)) {
+        PathNode* temp = a;
+        a = b;
+        b = temp;
+    }
+
+    if (!scheduler_pause_point(worker->scheduler)) {
+        return; // Stopped by a limit.
+    }
+
+    // Near the roots, a pair reached along another path is skipped.
+    if (a->size + b->size <= worker->visited_size &&
+        visited_skip(worker, a->size + b->size, visited_pair_key(path_hash(worker, a), path_hash(worker, b)))) {
+        return;
+    }
+    counter_add(&worker->stats->nodes, 1);
+
+    // The first fixed word holds the subset sums below 64, as a SumsetMask.
+    SumsetMask a_mask = words ? a->fixed.words[0] : a->mask;
+    SumsetMask b_mask = words ? b->fixed.words[0] : b->mask;
+    int a_sum = words ? a->fixed.sum : a->sumset.sum;
+    int a_last = words ? a->fixed.last : a->sumset.last;
+    int b_sum = words ? b->fixed.sum : b->sumset.sum;
+    int b_last = words ? b->fixed.last : b->sumset.last;
+    bool trivial = words ? sumset_fixed_is_intersection_trivial(&a->fixed, &b->fixed, words)
+                         : sumset_mask_may_be_trivial(a_mask, b_mask) &&
+                           is_sumset_intersection_trivial(&a->sumset, &b->sumset);
+
+    if (trivial) { // s(a) ∩ s(b) = {0}.
+        SumsetMask extensions = sumset_mask_extensions(b_mask, a_last, worker->input_data->d);
+        ChildParent parent = {a_mask, b_mask, a_sum, b_sum, b_last, worker->input_data->d};
+        ChildIterator children;
+        int8_t buffer[64];
+        int i;
+
+        child_iterator_init(&children, order, false, extensions, &parent, &worker->scores, buffer);
+
+        while (child_iterator_next(&children, &i)) {
+            if (can_prune(worker, a_sum + i, a->size + 1, i, b_sum, b->size, b_last)) {
+                counter_add(&worker->stats->pruned, 1);
+                continue;
+            }
+
+            bool donated = false;
+            if (is_anyone_idle(worker) && worker->donate && child_iterator_has_next(&children) &&
+                !is_throttled(worker)) {
+                donate_siblings(a, b, a_sum, b_sum, b_last, children, worker);
+                donated = true;
+            }
+
+            PathNode a_with_i;
+            if (words) {
+                sumset_fixed_add(&a_with_i.fixed, &a->fixed, i, words);
+            } else {
+                sumset_add(&a_with_i.sumset, &a->sumset, i);
+                a_with_i.mask = sumset_mask_add(a_mask, i);
+            }
+            a_with_i.size = a->size + 1;
+            a_with_i.element = i;
+            a_with_i.parent = a;
+            a_with_i.twin = NULL;
+            solve_recursive_call(&a_with_i, b, worker, order, words);
+
+            if (a_with_i.twin) {
+                sumset_release(worker->pool, a_with_i.twin);
+            }
+
+            if (donated) {
+                break;
+            }
+        }
+    } else if (a_sum == b_sum &&
+               (words ? sumset_fixed_intersection_size(&a->fixed, &b->fixed, words)
+                      : (int)get_sumset_intersection_size(&a->sumset, &b->sumset)) == 2) { // s(a) ∩ s(b) = {0, ∑b}.
+        child_scores_credit(&worker->scores, a_last, b_last);
+
+        if (!words) {
+            if (record_solution(worker, &a->sumset, &b->sumset)) {
+                keep_best(worker, path_share(a, worker->pool), path_share(b, worker->pool));
+            }
+        } else if (may_record(worker, b_sum)) {
+            Ref_sumset* shared_a = path_share(a, worker->pool);
+            Ref_sumset* shared_b = path_share(b, worker->pool);
+
+            if (record_solution(worker, &shared_a->this_sumset, &shared_b->this_sumset)) {
+                keep_best(worker, shared_a, shared_b);
+            }
+        }
+    }
+}
+
+// Recursive solution on generic sumsets in the default order, in which the children come straight from the mask.
+SUMSET_DISPATCH
+void solve_recursive_descending(PathNode* a, PathNode* b, Worker* worker) {
+    solve_recursive_ordered(a, b, worker, ORDER_DESCENDING, 0);
+}
+
+// Recursive solution on generic sumsets in any other order.
+SUMSET_DISPATCH
+void solve_recursive_other(PathNode* a, PathNode* b, Worker* worker) {
+    solve_recursive_ordered(a, b, worker, worker->order, 0);
+}
+
+// Define the recursions on fixed sumsets of the given number of bits, in the default order and in any other one.
+#define SOLVE_RECURSIVE_FIXED(bits)                                                        \
+    SUMSET_DISPATCH                                                                        \
+    void solve_recursive_descending_##bits(PathNode* a, PathNode* b, Worker* worker) {     \
+        solve_recursive_ordered(a, b, worker, ORDER_DESCENDING, (bits) / 64);              \
+    }                                                                                      \
+    SUMSET_DISPATCH                                                                        \
+    void solve_recursive_other_##bits(PathNode* a, PathNode* b, Worker* worker) {          \
+        solve_recursive_ordered(a, b, worker, worker->order, (bits) / 64);                 \
+    }
+
+SOLVE_RECURSIVE_FIXED(64)
+SOLVE_RECURSIVE_FIXED(128)
+SOLVE_RECURSIVE_FIXED(256)
+SOLVE_RECURSIVE_FIXED(512)
+
+// Recursive solution in the thread's order and width, see solve_recursive_ordered.
+static void solve_recursive(PathNode* a, PathNode* b, Worker* worker) {
+    solve_recursive_call(a, b, worker, worker->order, worker->words);
+}
+
+/*
+ * Worker thread function.
+ */
+void* worker_thread(void* arg) {
+    // Get the thread arguments.
+    ThreadArgs* args = (ThreadArgs*)arg;
+    Scheduler* scheduler = args->scheduler;
+    pthread_mutex_t* solution_mutex = args->mutex;
+    Worker* worker = args->worker;
+    int id = args->id;
+
+    // Initialize local variables.
+    *worker = (Worker){
+        .input_data = args->input_data,
+        .scheduler = scheduler,
+        .best_sum = args->best_sum,
+        .bound_sum = args->results ? &args->results->bound_sum : args->best_sum,
+        .pool = args->pool,
+        .stats = &scheduler->stats[id],
+        .prune = args->options->prune,
+        .delta = args->options->delta,
+        .order = args->options->order,
+        .donate = args->options->partition_depth < 0,
+        .words = sumset_fixed_words(args->input_data),
+        .scores = {{0}},
+        .sweep = args->sweep,
+        .memory_budget = args->options->memory_limit / scheduler->t,
+        .throttled_since = 0,
+        .id = id,
+        .anytime = (args->options->time_limit || args->options->node_limit) && !args->options->estimate_walks,
+        .start_time = args->start_time,
+        .instance = NULL,
+        .current = {NULL, NULL},
+        .best = {NULL, NULL},
+        .results = args->results,
+        .visited = args->visited
+    };
+    solution_init(&worker->best_solution);
+    if (worker->results) {
+        result_heap_init(&worker->heap, worker->results->merged.mode, args->options->top);
+    }
+    grain_init(&worker->grain, args->options, args->input_data);
+    worker->visited_size = worker->visited ? worker->grain.root_depth + worker->visited->depth : -1;
+
+    StackFrame frame;
+    Ref_sumset *a, *b;
+
+    while(true) {
+        PopResult popped = scheduler_pop(scheduler, id, &frame);
+        if (popped == POP_NONE) {
+            break; // No more tasks.
+        }
+
+        // Build the node of a delta frame, taking over the frame's reference to the parent.
+        if (frame.element) {
+            frame = (StackFrame){sumset_adopt(worker->pool, frame.a, frame.element), frame.b, 0};
+        }
+
+        // Frames of a batch's instances come in any order, switch to the frame's instance.
+        Instance* instance = frame.a->instance;
+        if (instance && instance != worker->instance) {
+            worker->instance = instance;
+            worker->input_data = &instance->input_data;
+            worker->best_sum = &instance->best_sum;
+            worker->bound_sum = &instance->best_sum;
+            worker->words = sumset_fixed_words(&instance->input_data);
+            grain_switch(&worker->grain, instance);
+        }
+
+        worker->current = frame;
+        bool stopped = !scheduler_pause_point(scheduler);
+
+        a = frame.b;
+        b = frame.a;
+
+        const Ref_sumset* smaller = a->this_sumset.sum <= b->this_sumset.sum ? a : b;
+        int depth = a->size + b->size;
+
+        // Solve the task iteratively or recursively, as decided by the granularity controller.
+        // Over the memory budget, the whole subtree is solved privately, as are the tasks of a static partition.
+        if (stopped) {
+            // Stopped by a limit, the frame is dropped.
+        } else if (popped != POP_TASK && !is_throttled(worker) &&
+            !grain_is_private(&worker->grain, scheduler, id, popped == POP_STOLEN, smaller, depth)) {
+            counter_add(&worker->stats->iterative, 1);
+            solve_iteratively(a, b, worker);
+        } else {
+            counter_add(&worker->stats->recursive, 1);
+            size_t nodes_before = counter_get(&worker->stats->nodes);
+            PathNode a_path, b_path;
+            path_init(&a_path, a, worker->words);
+            path_init(&b_path, b, worker->words);
+            solve_recursive(&a_path, &b_path, worker);
+            grain_learn(&worker->grain, smaller, counter_get(&worker->stats->nodes) - nodes_before);
+        }
+
+        // Release the sumsets taken from the deque.
+        worker->current = (StackFrame){NULL, NULL, 0};
+        sumset_release(worker->pool, a);
+        sumset_release(worker->pool, b);
+
+        if (instance) {
+            instance_frame_done(instance);
+        }
+    }
+
+    if (worker->throttled_since) {
+        counter_add(&worker->stats->throttled_ns, (size_t)((now() - worker->throttled_since) * 1e9));
+    }
+
+    // Update the global best solution.
+    ASSERT_ZERO(pthread_mutex_lock(solution_mutex));
+
+    if (worker->best_solution.sum > args->best_solution->sum) {
+        *args->best_solution = worker->best_solution;
+    }
+    ASSERT_ZERO(pthread_mutex_unlock(solution_mutex));
+
+    // Clean up resources. The pool is destroyed by main, nodes from it may still be
+    // on other threads' way back to it. worker->best is kept for the final snapshot.
+    grain_destroy(&worker->grain);
+
+    if (worker->results) {
+        ASSERT_ZERO(pthread_mutex_lock(&worker->results->mutex));
+        result_heap_merge(&worker->results->merged, &worker->heap, worker->results->spill);
+        ASSERT_ZERO(pthread_mutex_unlock(&worker->results->mutex));
+        result_heap_destroy(&worker->heap);
+    }
+
+    return 0;
+}
+
+
+/*
+ * Functions for snapshots.
+ */
+
+// Get the snapshot id of a node, adding it and its ancestors if needed.
+static int snapshot_add_ref(Snapshot* snapshot, const Checkpoint* checkpoint, const Ref_sumset* node) {
+    if (node == checkpoint->roots[0]) {
+        return SNAPSHOT_ROOT_A;
+    }
+    if (node == checkpoint->roots[1]) {
+        return SNAPSHOT_ROOT_B;
+    }
+
+    int id = snapshot_find(snapshot, node);
+    if (id < 0) {
+        int parent = snapshot_add_ref(snapshot, checkpoint, node->parent);
+        id = snapshot_add_node(snapshot, node, parent, node->this_sumset.last);
+    }
+
+    return id;
+}
+
+/*
+ * Copy and retain the frames of the frontier: those in the deques, those being solved and
+ * the tasks of the static partition not handed out yet. The frame a thread is solving is saved
+ * whole, so a part of it may be explored again after a resume. The nodes of the best
+ * solution are added as the last frame (NULLs if there is none). No thread may run.
+ */
+static size_t snapshot_collect(Checkpoint* checkpoint, Scheduler* scheduler, StackFrame** frames_out) {
+    int t = scheduler->t;
+    size_t next_task = atomic_load(&scheduler->next_task);
+    size_t tasks_left = next_task < scheduler->tasks_count ? scheduler->tasks_count - next_task : 0;
+    size_t capacity = t + 1 + tasks_left;
+    for (int i = 0; i < t; ++i) {
+        capacity += deque_size(&scheduler->deques[i]);
+    }
+
+    StackFrame* frames = malloc(sizeof(StackFrame) * capacity);
+
+    if (!frames) {
+        exit(ERROR);
+    }
+
+    size_t frames_count = 0;
+    for (int i = 0; i < t; ++i) {
+        frames_count += deque_copy(&scheduler->deques[i], frames + frames_count);
+
+        if (checkpoint->workers[i].current.a) {
+            frames[frames_count++] = checkpoint->workers[i].current;
+        }
+    }
+    for (size_t k = 0; k < tasks_left; ++k) {
+        frames[frames_count++] = scheduler->tasks[next_task + k];
+    }
+
+    StackFrame best = checkpoint->best;
+    int best_sum = checkpoint->best_sum;
+    for (int i = 0; i < t; ++i) {
+        if (checkpoint->workers[i].best_solution.sum > best_sum) {
+            best = checkpoint->workers[i].best;
+            best_sum = checkpoint->workers[i].best_solution.sum;
+        }
+    }
+    frames[frames_count++] = best;
+
+    for (size_t k = 0; k < frames_count; ++k) {
+        sumset_retain(frames[k].a);
+        sumset_retain(frames[k].b);
+    }
+
+    *frames_out = frames;
+    return frames_count;
+}
+
+/*
+ * Add frames to the snapshot and release them. If with_best is set, the last frame
+ * holds the nodes of the best solution (or NULLs). frames is freed.
+ */
+static void snapshot_fill(Snapshot* snapshot, const Checkpoint* checkpoint, StackFrame* frames,
+                          size_t frames_count, bool with_best) {
+    size_t count = with_best ? frames_count - 1 : frames_count;
+
+    for (size_t k = 0; k < count; ++k) {
+        int a = snapshot_add_ref(snapshot, checkpoint, frames[k].a);
+        if (frames[k].element) {
+            a = snapshot_add_node(snapshot, NULL, a, frames[k].element);
+        }
+        snapshot_add_frame(snapshot, a, snapshot_add_ref(snapshot, checkpoint, frames[k].b));
+    }
+
+    if (with_best && frames[count].a) {
+        snapshot->best_sum = frames[count].a->this_sumset.sum;
+        snapshot->best_a = snapshot_add_ref(snapshot, checkpoint, frames[count].a);
+        snapshot->best_b = snapshot_add_ref(snapshot, checkpoint, frames[count].b);
+    }
+
+    // The main thread has no pool, the nodes go back to their owners.
+    for (size_t k = 0; k < frames_count; ++k) {
+        sumset_release(NULL, frames[k].a);
+        sumset_release(NULL, frames[k].b);
+    }
+    free(frames);
+}
+
+// Write the collected frames to the snapshot file and release them.
+static void snapshot_save(Checkpoint* checkpoint, StackFrame* frames, size_t frames_count,
+                          InputData* input_data, const Options* options) {
+    Snapshot snapshot;
+    snapshot_init(&snapshot, input_data);
+    snapshot_fill(&snapshot, checkpoint, frames, frames_count, true);
+
+    if (snapshot_write(&snapshot, options->checkpoint)) {
+        checkpoint->snapshots++;
+    } else {
+        perror(options->checkpoint);
+    }
+
+    snapshot_destroy(&snapshot);
+}
+
+/*
+ * Write the frontier of the running search to the snapshot file. The threads are
+ * stopped only while the frames are collected; the file is written afterwards, as
+ * the retained nodes do not change anymore.
+ */
+void snapshot_take(Checkpoint* checkpoint, Scheduler* scheduler, InputData* input_data, const Options* options) {
+    double start = now();
+
+    if (!scheduler_stop(scheduler)) {
+        return; // The search has finished.
+    }
+
+    StackFrame* frames;
+    size_t frames_count = snapshot_collect(checkpoint, scheduler, &frames);
+
+    scheduler_resume(scheduler);
+    checkpoint->longest_pause = fmax(checkpoint->longest_pause, now() - start);
+
+    snapshot_save(checkpoint, frames, frames_count, input_data, options);
+}
+
+// Create the nodes of a snapshot, by id. Each node holds a reference for the table.
+static Ref_sumset** snapshot_nodes(const Snapshot* snapshot, Ref_sumset* const roots[2], RefSumsetPool* pool) {
+    Ref_sumset** nodes = malloc(sizeof(Ref_sumset*) * snapshot->nodes_count);
+
+    if (!nodes) {
+        exit(ERROR);
+    }
+
+    nodes[SNAPSHOT_ROOT_A] = roots[0];
+    nodes[SNAPSHOT_ROOT_B] = roots[1];
+
+    for (size_t k = 2; k < snapshot->nodes_count; ++k) {
+        nodes[k] = sumset_extend(pool, nodes[snapshot->nodes[k].parent], snapshot->nodes[k].element);
+    }
+
+    return nodes;
+}
+
+// Drop the references of the table, nodes outside all frames are freed.
+static void snapshot_nodes_release(const Snapshot* snapshot, Ref_sumset** nodes, RefSumsetPool* pool) {
+    for (size_t k = 2; k < snapshot->nodes_count; ++k) {
+        sumset_release(pool, nodes[k]);
+    }
+
+    free(nodes);
+}
+
+/*
+ * Rebuild the frames and the best solution of a snapshot. The frames are spread over
+ * the deques of all threads, whose number may differ from that of the snapshotted run.
+ * Called before the threads start; the nodes are allocated from the given pool.
+ */
+void snapshot_restore(const Snapshot* snapshot, Checkpoint* checkpoint, Scheduler* scheduler,
+                      Solution* best_solution, atomic_int* best_sum, InputData* input_data, RefSumsetPool* pool) {
+    Ref_sumset** nodes = snapshot_nodes(snapshot, checkpoint->roots, pool);
+
+    for (size_t k = 0; k < snapshot->frames_count; ++k) {
+        StackFrame frame = {nodes[snapshot->frames[k].a], nodes[snapshot->frames[k].b], 0};
+
+        sumset_retain(frame.a);
+        sumset_retain(frame.b);
+        scheduler_push(scheduler, k % scheduler->t, frame);
+    }
+
+    if (snapshot->best_a >= 0) {
+        checkpoint->best = (StackFrame){nodes[snapshot->best_a], nodes[snapshot->best_b], 0};
+        checkpoint->best_sum = snapshot->best_sum;
+        sumset_retain(checkpoint->best.a);
+        sumset_retain(checkpoint->best.b);
+
+        solution_build(best_solution, input_data, &checkpoint->best.a->this_sumset, &checkpoint->best.b->this_sumset);
+        atomic_store(best_sum, snapshot->best_sum);
+    }
+
+    snapshot_nodes_release(snapshot, nodes, pool);
+}
+
+// Parse the command line options.
+void options_parse(Options* options, int argc, char* argv[]) {
+    static const struct option long_options[] = {
+        {"no-prune", no_argument, NULL, 'P'},
+        {"stats", no_argument, NULL, 's'},
+        {"grain", required_argument, NULL, 'g'},
+        {"cutoff", required_argument, NULL, 'c'},
+        {"frames", required_argument, NULL, 'f'},
+        {"checkpoint", required_argument, NULL, 'k'},
+        {"interval", required_argument, NULL, 'i'},
+        {"resume", required_argument, NULL, 'r'},
+        {"coordinator", required_argument, NULL, 'C'},
+        {"workers", required_argument, NULL, 'w'},
+        {"worker", required_argument, NULL, 'W'},
+        {"prefix-depth", required_argument, NULL, 'p'},
+        {"memory-limit", required_argument, NULL, 'm'},
+        {"batch", no_argument, NULL, 'B'},
+        {"sweep", required_argument, NULL, 'S'},
+        {"order", required_argument, NULL, 'o'},
+        {"time-limit", required_argument, NULL, 't'},
+        {"node-limit", required_argument, NULL, 'n'},
+        {"estimate", required_argument, NULL, 'e'},
+        {"progress", required_argument, NULL, 'E'},
+        {"partition", required_argument, NULL, 'D'},
+        {"tasks", required_argument, NULL, 'T'},
+        {"affinity", required_argument, NULL, 'A'},
+        {"steal", required_argument, NULL, 'L'},
+        {"top", required_argument, NULL, 'K'},
+        {"all-optimal", no_argument, NULL, 'O'},
+        {"results", required_argument, NULL, 'R'},
+        {"visited", required_argument, NULL, 'V'},
+        {"visited-depth", required_argument, NULL, 'v'},
+        {NULL, 0, NULL, 0}
+    };
+
+    options->prune = true;
+    options->stats = false;
+    options->grain = GRAIN_ADAPTIVE;
+    options->cutoff = GRAIN_DEFAULT_CUTOFF;
+    options->delta = false;
+    options->checkpoint = NULL;
+    options->interval = 600;
+    options->resume = NULL;
+    options->coordinator = NULL;
+    options->worker = NULL;
+    options->workers = 0;
+    options->prefix_depth = 2;
+    options->memory_limit = 0;
+    options->batch = false;
+    options->sweep_last = 0;
+    options->order = ORDER_DESCENDING;
+    options->time_limit = 0;
+    options->node_limit = 0;
+    options->estimate_walks = 0;
+    options->progress = 0;
+    options->partition_depth = -1;
+    options->tasks = NULL;
+    options->affinity = AFFINITY_NONE;
+    options->local_steals = true;
+    options->top = 0;
+    options->all_optimal = false;
+    options->results = NULL;
+    options->visited_bytes = 0;
+    options->visited_depth = VISITED_DEPTH;
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "Psg:c:f:k:i:r:C:w:W:p:m:BS:o:t:n:e:E:D:T:A:L:K:OR:V:v:", long_options, NULL)) != -1) {
+        switch (opt) {
+            case 'P':
+                options->prune = false;
+                break;
+            case 's':
+                options->stats = true;
+                break;
+            case 'g':
+                if (strcmp(optarg, "queue") == 0) {
+                    options->grain = GRAIN_QUEUE;
+                } else if (strcmp(optarg, "static") == 0) {
+                    options->grain = GRAIN_STATIC;
+                } else if (strcmp(optarg, "adaptive") == 0) {
+                    options->grain = GRAIN_ADAPTIVE;
+                } else {
+                    fprintf(stderr, "Unknown granularity policy: %s\n", optarg);
+                    exit(ERROR);
+                }
+                break;
+            case 'c':
+                options->cutoff = strtod(optarg, NULL);
+                if (!(options->cutoff >= 1)) {
+                    fprintf(stderr, "Invalid cutoff: %s\n", optarg);
+                    exit(ERROR);
+                }
+                break;
+            case 'f':
+                if (strcmp(optarg, "full") == 0) {
+                    options->delta = false;
+                } else if (strcmp(optarg, "delta") == 0) {
+                    options->delta = true;
+                } else {
+                    fprintf(stderr, "Unknown frame layout: %s\n", optarg);
+                    exit(ERROR);
+                }
+                break;
+            case 'k':
+                options->checkpoint = optarg;
+                break;
+            case 'i':
+                options->interval = strtod(optarg, NULL);
+                if (!(options->interval > 0)) {
+                    fprintf(stderr, "Invalid snapshot interval: %s\n", optarg);
+                    exit(ERROR);
+                }
+                break;
+            case 'r':
+                options->resume = optarg;
+                break;
+            case 'C':
+                options->coordinator = optarg;
+                break;
+            case 'w':
+                options->workers = atoi(optarg);
+                if (options->workers < 0) {
+                    fprintf(stderr, "Invalid number of workers: %s\n", optarg);
+                    exit(ERROR);
+                }
+                break;
+            case 'W':
+                options->worker = optarg;
+                break;
+            case 'p':
+                options->prefix_depth = atoi(optarg);
+                if (options->prefix_depth < 0) {
+                    fprintf(stderr, "Invalid prefix depth: %s\n", optarg);
+                    exit(ERROR);
+                }
+                break;
+            case 'm': {
+                double megabytes = strtod(optarg, NULL);
+                if (!(megabytes > 0)) {
+                    fprintf(stderr, "Invalid memory limit: %s\n", optarg);
+                    exit(ERROR);
+                }
+                options->memory_limit = (size_t)(megabytes * 1024 * 1024);
+                break;
+            }
+            case 'B':
+                options->batch = true;
+                break;
+            case 'o':
+                if (!child_order_parse(optarg, &options->order)) {
+                    fprintf(stderr, "Unknown child order: %s\n", optarg);
+                    exit(ERROR);
+                }
+                break;
+            case 'S':
+                options->sweep_last = atoi(optarg);
+                if (options->sweep_last < 1 || options->sweep_last > MAX_D) {
+                    fprintf(stderr, "Invalid last d of the sweep: %s\n", optarg);
+                    exit(ERROR);
+                }
+                break;
+            case 't':
+                options->time_limit = strtod(optarg, NULL);
+                if (!(options->time_limit > 0)) {
+                    fprintf(stderr, "Invalid time limit: %s\n", optarg);
+                    exit(ERROR);
+                }
+                break;
+            case 'n':
+                options->node_limit = strtoull(optarg, NULL, 10);
+                if (options->node_limit == 0) {
+                    fprintf(stderr, "Invalid node limit: %s\n", optarg);
+                    exit(ERROR);
+                }
+                break;
+            case 'e':
+                options->estimate_walks = strtoull(optarg, NULL, 10);
+                if (options->estimate_walks == 0) {
+                    fprintf(stderr, "Invalid number of walks: %s\n", optarg);
+                    exit(ERROR);
+                }
+                break;
+            case 'E':
+                options->progress = strtod(optarg, NULL);
+                if (!(options->progress > 0)) {
+                    fprintf(stderr, "Invalid progress interval: %s\n", optarg);
+                    exit(ERROR);
+                }
+                break;
+            case 'D':
+                options->partition_depth = atoi(optarg);
+                if (options->partition_depth < 0) {
+                    fprintf(stderr, "Invalid partition depth: %s\n", optarg);
+                    exit(ERROR);
+                }
+                break;
+            case 'T':
+                options->tasks = optarg;
+                break;
+            case 'A':
+                if (!affinity_parse(optarg, &options->affinity)) {
+                    fprintf(stderr, "Unknown affinity: %s\n", optarg);
+                    exit(ERROR);
+                }
+                break;
+            case 'L':
+                if (strcmp(optarg, "local") == 0) {
+                    options->local_steals = true;
+                } else if (strcmp(optarg, "any") == 0) {
+                    options->local_steals = false;
+                } else {
+                    fprintf(stderr, "Unknown steal policy: %s\n", optarg);
+                    exit(ERROR);
+                }
+                break;
+            case 'K':
+                options->top = atoi(optarg);
+                if (options->top <= 0) {
+                    fprintf(stderr, "Invalid number of solutions: %s\n", optarg);
+                    exit(ERROR);
+                }
+                break;
+            case 'O':
+                options->all_optimal = true;
+                break;
+            case 'R':
+                options->results = optarg;
+                break;
+            case 'V': {
+                double megabytes = strtod(optarg, NULL);
+                if (!(megabytes > 0)) {
+                    fprintf(stderr, "Invalid visited table size: %s\n", optarg);
+                    exit(ERROR);
+                }
+                options->visited_bytes = (size_t)(megabytes * 1024 * 1024);
+                break;
+            }
+            case 'v':
+                options->visited_depth = atoi(optarg);
+                if (options->visited_depth < 0 || options->visited_depth > VISITED_MAX_DEPTH) {
+                    fprintf(stderr, "Invalid visited depth: %s\n", optarg);
+                    exit(ERROR);
+                }
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [--no-prune] [--stats] [--grain queue|static|adaptive] [--cutoff nodes] "
+                                "[--frames full|delta] [--memory-limit MiB] [--order descending|ascending|capacity|learned] "
+                                "[--checkpoint file] [--interval seconds] [--resume file] "
+                                "[--time-limit seconds] [--node-limit nodes] [--progress seconds] [--estimate walks] "
+                                "[--partition depth [--tasks file]] [--affinity none|compact|scatter [--steal local|any]] "
+                                "[--top k | --all-optimal] [--results file] [--visited MiB [--visited-depth d]] "
+                                "[--coordinator socket [--workers n] [--prefix-depth d] | --worker socket | --batch | --sweep d] "
+                                "< input\n",
+                        argv[0]);
+                exit(ERROR);
+        }
+    }
+
+    if (options->batch && (options->checkpoint || options->resume || options->coordinator || options->worker)) {
+        fprintf(stderr, "--batch cannot be combined with snapshots or a sharded search\n");
+        exit(ERROR);
+    }
+
+    if (options->sweep_last &&
+        (options->batch || options->checkpoint || options->resume || options->coordinator || options->worker)) {
+        fprintf(stderr, "--sweep cannot be combined with --batch, snapshots or a sharded search\n");
+        exit(ERROR);
+    }
+
+    if ((options->time_limit || options->node_limit) &&
+        (options->batch || options->sweep_last || options->coordinator || options->worker)) {
+        fprintf(stderr, "--time-limit and --node-limit cannot be combined with --batch, --sweep or a sharded search\n");
+        exit(ERROR);
+    }
+
+    if ((options->estimate_walks || options->progress) &&
+        (options->batch || options->sweep_last || options->coordinator || options->worker)) {
+        fprintf(stderr, "--estimate and --progress cannot be combined with --batch, --sweep or a sharded search\n");
+        exit(ERROR);
+    }
+
+    if (options->estimate_walks && (options->checkpoint || options->resume)) {
+        fprintf(stderr, "--estimate cannot be combined with snapshots\n");
+        exit(ERROR);
+    }
+
+    if (options->partition_depth >= 0 &&
+        (options->batch || options->sweep_last || options->coordinator || options->worker || options->memory_limit)) {
+        fprintf(stderr, "--partition cannot be combined with --batch, --sweep, --memory-limit or a sharded search\n");
+        exit(ERROR);
+    }
+
+    if (options->tasks && options->partition_depth < 0) {
+        fprintf(stderr, "--tasks needs --partition\n");
+        exit(ERROR);
+    }
+
+    // The table keys pairs by their multisets alone, the instances of a batch would mix.
+    if (options->visited_bytes && options->batch) {
+        fprintf(stderr, "--visited cannot be combined with --batch\n");
+        exit(ERROR);
+    }
+
+    if (options->top && options->all_optimal) {
+        fprintf(stderr, "--top and --all-optimal cannot be combined\n");
+        exit(ERROR);
+    }
+
+    if ((options->top || options->all_optimal) != (options->results != NULL)) {
+        fprintf(stderr, "--top and --all-optimal need --results, and --results needs one of them\n");
+        exit(ERROR);
+    }
+
+    // The prefixes expanded by the main thread, snapshots and shards carry the best solution only.
+    if (options->results &&
+        (options->batch || options->sweep_last || options->coordinator || options->worker || options->checkpoint ||
+         options->resume || options->estimate_walks || options->partition_depth >= 0)) {
+        fprintf(stderr, "--top and --all-optimal cannot be combined with --batch, --sweep, --estimate, --partition, "
+                        "snapshots or a sharded search\n");
+        exit(ERROR);
+    }
+}
+
+
+/*
+ * Functions for the prefix of the tree, expanded breadth first by the main thread
+ * before the frames below it are handed out (see shard_coordinator and search_partition).
+ */
+
+// Record a solution given by its nodes in the checkpoint if it beats the best one there.
+static void checkpoint_record(Checkpoint* checkpoint, Solution* best_solution, InputData* input_data,
+                              RefSumsetPool* pool, Ref_sumset* a, Ref_sumset* b) {
+    if (a->this_sumset.sum <= checkpoint->best_sum) {
+        return;
+    }
+
+    solution_build(best_solution, input_data, &a->this_sumset, &b->this_sumset);
+
+    sumset_retain(a);
+    sumset_retain(b);
+    sumset_release(pool, checkpoint->best.a);
+    sumset_release(pool, checkpoint->best.b);
+    checkpoint->best = (StackFrame){a, b, 0};
+    checkpoint->best_sum = a->this_sumset.sum;
+}
+
+static void prefix_add(Prefix* prefix, StackFrame frame) {
+    if (prefix->frames_count == prefix->frames_capacity) {
+        prefix->frames_capacity = prefix->frames_capacity ? prefix->frames_capacity * 2 : 64;
+        prefix->frames = realloc(prefix->frames, sizeof(StackFrame) * prefix->frames_capacity);
+
+        if (!prefix->frames) {
+            exit(ERROR);
+        }
+    }
+
+    prefix->frames[prefix->frames_count++] = frame;
+}
+
+// Expand a frame one level, adding its children to the prefix's frames. The frame's references are released.
+static void prefix_expand_frame(Prefix* prefix, StackFrame frame) {
+    Ref_sumset* a = frame.a;
+    Ref_sumset* b = frame.b;
+    int d = prefix->input_data->d;
+
+    if (a->this_sumset.sum > b->this_sumset.sum) {
+        a = frame.b;
+        b = frame.a;
+    }
+
+    if (sumset_mask_may_be_trivial(a->mask, b->mask) &&
+        is_sumset_intersection_trivial(&a->this_sumset, &b->this_sumset)) {
+        SumsetMask extensions = sumset_mask_extensions(b->mask, a->this_sumset.last, d);
+
+        while (extensions) {
+            int i = sumset_mask_pop(&extensions);
+
+            if (prefix->prune &&
+                solution_upper_bound(a->this_sumset.sum + i, a->size + 1, b->this_sumset.sum, b->size, d) <=
+                prefix->checkpoint->best_sum) {
+                continue;
+            }
+
+            sumset_retain(b);
+            prefix_add(prefix, (StackFrame){sumset_extend(prefix->pool, a, i), b, 0});
+        }
+    } else if ((a->this_sumset.sum == b->this_sumset.sum) && (get_sumset_intersection_size(&a->this_sumset, &b->this_sumset) == 2)) {
+        checkpoint_record(prefix->checkpoint, prefix->best_solution, prefix->input_data, prefix->pool, a, b);
+    }
+
+    sumset_release(prefix->pool, a);
+    sumset_release(prefix->pool, b);
+}
+
+/*
+ * Search the subtree of (a, b) depth first, the largest child first, recording the
+ * solutions found, until budget nodes are spent. The references to a and b stay with the caller.
+ */
+static void prefix_probe(Prefix* prefix, Ref_sumset* a, Ref_sumset* b, size_t* budget) {
+    int d = prefix->input_data->d;
+
+    if (*budget == 0) {
+        return;
+    }
+    --*budget;
+
+    if (a->this_sumset.sum > b->this_sumset.sum) {
+        Ref_sumset* temp = a;
+        a = b;
+        b = temp;
+    }
+
+    if (sumset_mask_may_be_trivial(a->mask, b->mask) &&
+        is_sumset_intersection_trivial(&a->this_sumset, &b->this_sumset)) {
+        SumsetMask extensions = sumset_mask_extensions(b->mask, a->this_sumset.last, d);
+
+        while (extensions && *budget > 0) {
+            int i = 63 - __builtin_clzll(extensions);
+            extensions &= ~((SumsetMask)1 << i);
+
+            if (prefix->prune &&
+                solution_upper_bound(a->this_sumset.sum + i, a->size + 1, b->this_sumset.sum, b->size, d) <=
+                prefix->checkpoint->best_sum) {
+                continue;
+            }
+
+            Ref_sumset* child = sumset_extend(prefix->pool, a, i);
+            prefix_probe(prefix, child, b, budget);
+            sumset_release(prefix->pool, child);
+        }
+    } else if ((a->this_sumset.sum == b->this_sumset.sum) && (get_sumset_intersection_size(&a->this_sumset, &b->this_sumset) == 2)) {
+        checkpoint_record(prefix->checkpoint, prefix->best_solution, prefix->input_data, prefix->pool, a, b);
+    }
+}
+
+// Replace the prefix's frames by the frames depth levels below them, in the same order.
+static void prefix_expand(Prefix* prefix, int depth) {
+    for (int level = 0; level < depth && prefix->frames_count > 0; ++level) {
+        StackFrame* frames = prefix->frames;
+        size_t frames_count = prefix->frames_count;
+
+        prefix->frames = NULL;
+        prefix->frames_count = 0;
+        prefix->frames_capacity = 0;
+
+        for (size_t k = 0; k < frames_count; ++k) {
+            prefix_expand_frame(prefix, frames[k]);
+        }
+
+        free(frames);
+    }
+}
+
+
+/*
+ * Functions for running the search engine.
+ */
+
+// Create the nodes of a_start and b_start, with one reference each. They belong to no pool.
+static void roots_create(Ref_sumset* roots[2], InputData* input_data) {
+    const Sumset* starts[2] = {&input_data->a_start, &input_data->b_start};
+
+    for (int k = 0; k < 2; ++k) {
+        roots[k] = malloc(sizeof(Ref_sumset));
+
+        if (!roots[k]) {
+            exit(ERROR);
+        }
+
+        roots[k]->this_sumset = *starts[k];
+        roots[k]->ref_count = 1;
+        roots[k]->size = sumset_size_lower_bound(starts[k], input_data->d);
+        roots[k]->mask = sumset_mask_of(starts[k]);
+        roots[k]->parent = NULL;
+        roots[k]->owner = NULL;
+        roots[k]->instance = NULL;
+    }
+}
+
+// Prepare a search of the input with input_data.t threads.
+void search_init(Search* search, InputData* input_data, const Options* options) {
+    int t = input_data->t;
+
+    search->input_data = input_data;
+    search->options = options;
+    scheduler_init(&search->scheduler, t);
+
+    // Create one memory pool per thread. Pools outlive the threads, since a node
+    // may be released by a thread other than its owner.
+    search->pools = aligned_alloc(alignof(RefSumsetPool), sizeof(RefSumsetPool) * t);
+    search->workers = malloc(sizeof(Worker) * t);
+    search->threads = malloc(sizeof(pthread_t) * t);
+    search->thread_args = malloc(sizeof(ThreadArgs) * t);
+
+    if (!search->pools || !search->workers || !search->threads || !search->thread_args) {
+        exit(ERROR);
+    }
+
+    for (int i = 0; i < t; ++i) {
+        pool_init(&search->pools[i]);
+    }
+
+    // The search keeps a reference to the roots until the end.
+    Ref_sumset* roots[2];
+    roots_create(roots, input_data);
+
+    search->checkpoint = (Checkpoint){
+        .roots = {roots[0], roots[1]},
+        .workers = search->workers,
+        .best = {NULL, NULL},
+        .best_sum = 0,
+        .snapshots = 0,
+        .longest_pause = 0
+    };
+
+    solution_init(&search->best_solution);
+    atomic_init(&search->best_sum, 0);
+    atomic_init(&search->joined, false);
+    search->batch = NULL;
+    search->sweep = NULL;
+    search->stop_reason = NULL;
+    search->frontier = NULL;
+    search->frontier_count = 0;
+    search->partition_tasks = 0;
+    search->partition_nodes = 0;
+    search->partition_largest = 0;
+    ASSERT_ZERO(pthread_mutex_init(&search->solution_mutex, NULL));
+
+    if (options->affinity != AFFINITY_NONE) {
+        topology_read(&search->topology);
+        search->scheduler.nodes = malloc(sizeof(int) * t);
+
+        if (!search->scheduler.nodes) {
+            exit(ERROR);
+        }
+
+        for (int i = 0; i < t; ++i) {
+            search->scheduler.nodes[i] = search->topology.nodes[topology_place(&search->topology, options->affinity, i)];
+        }
+
+        // On a single node the first pass of scheduler_pop would already try every thread.
+        search->scheduler.local_steals = options->local_steals && search->topology.nodes_count > 1;
+    }
+
+    search->results = NULL;
+    if (options->results) {
+        search->results = malloc(sizeof(Results));
+
+        if (!search->results) {
+            exit(ERROR);
+        }
+
+        result_heap_init(&search->results->merged, options->all_optimal ? RESULTS_OPTIMAL : RESULTS_TOP,
+                         options->top);
+        search->results->spill = NULL;
+        atomic_init(&search->results->bound_sum, 0);
+        ASSERT_ZERO(pthread_mutex_init(&search->results->mutex, NULL));
+        search->results->written = 0;
+
+        if (options->all_optimal && !(search->results->spill = results_spill_open(options->results))) {
+            syserr("Cannot open a spill file next to %s", options->results);
+        }
+    }
+
+    if (options->visited_bytes) {
+        visited_init(&search->visited, options->visited_bytes, options->visited_depth);
+    }
+}
+
+/*
+ * Push the roots' frame of every instance, spread over the deques. The threads have not
+ * started yet. Each deque gets its instances in reverse, so that its owner takes them in
+ * input order while thieves take the last ones.
+ */
+static void batch_push_roots(Batch* batch, Scheduler* scheduler) {
+    for (size_t k = batch->count; k-- > 0;) {
+        Instance* instance = batch->instances[k];
+
+        // The instance keeps its own references to the roots until it is printed.
+        sumset_retain(instance->roots[0]);
+        sumset_retain(instance->roots[1]);
+        scheduler_push(scheduler, (int)(k % scheduler->t), (StackFrame){instance->roots[0], instance->roots[1], 0});
+    }
+}
+
+// Order of the tasks of the static partition: by decreasing cost, then as expanded.
+static int partition_task_compare(const void* x, const void* y) {
+    const PartitionTask* a = x;
+    const PartitionTask* b = y;
+
+    if (a->cost != b->cost) {
+        return a->cost > b->cost ? -1 : 1;
+    }
+
+    return a->index < b->index ? -1 : (a->index > b->index);
+}
+
+// Estimated number of nodes of the subtree of a frame by the given number of walks, pruned with best_sum unless prune is off.
+static double partition_task_cost(StackFrame frame, int walks, int d, int best_sum, bool prune) {
+    const Ref_sumset* a = frame.a;
+    const Ref_sumset* b = frame.b;
+    TreeEstimate estimate;
+
+    // Seeded by the frame itself, so that a task gets the same estimate wherever it is in a list.
+    unsigned int seed = (unsigned int)(a->this_sumset.sum * 4099 + a->this_sumset.last * 257 +
+                                       b->this_sumset.sum * 31 + b->this_sumset.last);
+
+    tree_estimate_init(&estimate, best_sum, prune);
+    for (int k = 0; k < walks; ++k) {
+        tree_estimate_walk_from(&estimate, &a->this_sumset, a->size, &b->this_sumset, b->size, d, &seed);
+    }
+
+    return tree_estimate_nodes(&estimate);
+}
+
+// Write the tasks of the static partition and the best solution so far to the tasks file, as a snapshot.
+static void partition_write(Search* search) {
+    Scheduler* scheduler = &search->scheduler;
+    Checkpoint* checkpoint = &search->checkpoint;
+    StackFrame* frames = malloc(sizeof(StackFrame) * (scheduler->tasks_count + 1));
+
+    if (!frames) {
+        exit(ERROR);
+    }
+
+    for (size_t k = 0; k < scheduler->tasks_count; ++k) {
+        frames[k] = scheduler->tasks[k];
+    }
+    frames[scheduler->tasks_count] = checkpoint->best;
+
+    for (size_t k = 0; k <= scheduler->tasks_count; ++k) {
+        sumset_retain(frames[k].a);
+        sumset_retain(frames[k].b);
+    }
+
+    Snapshot snapshot;
+    snapshot_init(&snapshot, search->input_data);
+    snapshot_fill(&snapshot, checkpoint, frames, scheduler->tasks_count + 1, true);
+
+    if (!snapshot_write(&snapshot, search->options->tasks)) {
+        perror(search->options->tasks);
+    }
+
+    snapshot_destroy(&snapshot);
+}
+
+/*
+ * Replace the frames pushed so far by the tasks of the static partition: the frames
+ * partition_depth levels below them, expanded breadth first by the main thread and sorted
+ * by decreasing estimated cost, pruned with the best sum of a short dive. The threads take the tasks in this order from a single
+ * atomic counter and solve each one privately, donating nothing, so that they share no
+ * deque. The frames of a snapshot resumed at depth 0, such as a tasks file, are replayed
+ * in the snapshot's order, with neither dive nor sort. The threads have not started yet.
+ */
+static void search_partition(Search* search) {
+    Scheduler* scheduler = &search->scheduler;
+    Checkpoint* checkpoint = &search->checkpoint;
+    bool replay = search->options->resume && search->options->partition_depth == 0;
+    Prefix prefix = {search->input_data, search->options->prune, &search->pools[0], checkpoint,
+                     &search->best_solution, NULL, 0, 0};
+
+    // The frames were pushed round robin, take them back in the order they were pushed.
+    for (bool taken = true; taken;) {
+        taken = false;
+
+        for (int i = 0; i < scheduler->t; ++i) {
+            StackFrame frame;
+
+            if (deque_steal(&scheduler->deques[i], &frame)) {
+                prefix_add(&prefix, frame);
+                taken = true;
+            }
+        }
+    }
+
+    // Without a good best sum, the tasks taken first would prune little. A short dive in the
+    // default order finds one, as the first frames of the dynamic scheduler do. A replayed
+    // snapshot has the best sum of the search that wrote it.
+    size_t budget = replay ? 0 : PARTITION_PROBE;
+    for (size_t k = 0; k < prefix.frames_count; ++k) {
+        prefix_probe(&prefix, prefix.frames[k].a, prefix.frames[k].b, &budget);
+    }
+
+    prefix_expand(&prefix, search->options->partition_depth);
+    atomic_store(&search->best_sum, checkpoint->best_sum);
+
+    PartitionTask* tasks = malloc(sizeof(PartitionTask) * (prefix.frames_count + 1));
+    size_t walks = PARTITION_WALKS / (prefix.frames_count + 1);
+    walks = walks < 4 ? 4 : (walks > PARTITION_TASK_WALKS ? PARTITION_TASK_WALKS : walks);
+
+    if (!tasks) {
+        exit(ERROR);
+    }
+
+    for (size_t k = 0; k < prefix.frames_count; ++k) {
+        double cost = partition_task_cost(prefix.frames[k], (int)walks, search->input_data->d, checkpoint->best_sum,
+                                          search->options->prune);
+
+        tasks[k] = (PartitionTask){prefix.frames[k], cost, k};
+        search->partition_nodes += cost;
+        search->partition_largest = fmax(search->partition_largest, cost);
+    }
+
+    if (!replay) {
+        qsort(tasks, prefix.frames_count, sizeof(PartitionTask), partition_task_compare);
+    }
+
+    for (size_t k = 0; k < prefix.frames_count; ++k) {
+        prefix.frames[k] = tasks[k].frame;
+    }
+    free(tasks);
+
+    scheduler->tasks = prefix.frames;
+    scheduler->tasks_count = prefix.frames_count;
+    search->partition_tasks = prefix.frames_count;
+
+    if (search->options->tasks) {
+        partition_write(search);
+    }
+}
+
+// Add the counters of a thread to total. total must not be shared.
+static void stats_add(Stats* total, Stats* stats) {
+    counter_add(&total->nodes, counter_get(&stats->nodes));
+    counter_add(&total->pruned, counter_get(&stats->pruned));
+    counter_add(&total->recursive, counter_get(&stats->recursive));
+    counter_add(&total->iterative, counter_get(&stats->iterative));
+    counter_add(&total->donated, counter_get(&stats->donated));
+    counter_add(&total->throttled_ns, counter_get(&stats->throttled_ns));
+    counter_add(&total->visited_seen, counter_get(&stats->visited_seen));
+    counter_add(&total->visited_claimed, counter_get(&stats->visited_claimed));
+    counter_add(&total->visited_evicted, counter_get(&stats->visited_evicted));
+    counter_add(&total->visited_dropped, counter_get(&stats->visited_dropped));
+#if PARALLEL_COUNTERS
+    counter_add(&total->peak_frames, counter_get(&stats->peak_frames));
+    counter_add(&total->pushes, counter_get(&stats->pushes));
+    counter_add(&total->pops, counter_get(&stats->pops));
+    counter_add(&total->steals, counter_get(&stats->steals));
+    counter_add(&total->failed_steals, counter_get(&stats->failed_steals));
+    counter_add(&total->remote_steals, counter_get(&stats->remote_steals));
+    counter_add(&total->waits, counter_get(&stats->waits));
+    counter_add(&total->wait_ns, counter_get(&stats->wait_ns));
+#endif
+}
+
+// Print one row of the table of search_print_stats.
+static void stats_print_row(const char* name, Stats* stats, size_t blocks) {
+    fprintf(stderr, "%-6s %12zu %10zu %9zu %9zu %8zu %10.3f", name, counter_get(&stats->nodes),
+            counter_get(&stats->pruned), counter_get(&stats->recursive), counter_get(&stats->iterative),
+            counter_get(&stats->donated), counter_get(&stats->throttled_ns) * 1e-6);
+#if PARALLEL_COUNTERS
+    fprintf(stderr, " %8zu %10zu %10zu %8zu %8zu %8zu %7zu %10.3f", counter_get(&stats->peak_frames),
+            counter_get(&stats->pushes), counter_get(&stats->pops), counter_get(&stats->steals),
+            counter_get(&stats->failed_steals), counter_get(&stats->remote_steals), counter_get(&stats->waits), counter_get(&stats->wait_ns) * 1e-6);
+#endif
+    fprintf(stderr, " %7zu\n", blocks);
+}
+
+/*
+ * Print the statistics summed over all threads, then per thread. While the threads
+ * are running only the counters are read, the pools' other statistics are their own.
+ */
+void search_print_stats(Search* search, bool running) {
+    int t = search->input_data->t;
+    Stats total;
+    size_t blocks = 0;
+
+    memset(&total, 0, sizeof(Stats));
+    for (int i = 0; i < t; ++i) {
+        stats_add(&total, &search->scheduler.stats[i]);
+        blocks += counter_get(&search->pools[i].blocks);
+    }
+
+    int words = sumset_fixed_words(search->input_data);
+
+    fprintf(stderr, "kernels: %s\n", sumset_dispatch_isa());
+    if (words) {
+        fprintf(stderr, "sumsets: %d bits\n", 64 * words);
+    } else {
+        fprintf(stderr, "sumsets: generic\n");
+    }
+    fprintf(stderr, "nodes: %zu\npruned: %zu\nrecursive: %zu\niterative: %zu\ndonated: %zu\n",
+            counter_get(&total.nodes), counter_get(&total.pruned), counter_get(&total.recursive),
+            counter_get(&total.iterative), counter_get(&total.donated));
+    fprintf(stderr, "throttled: %.3f ms\n", counter_get(&total.throttled_ns) * 1e-6);
+#if PARALLEL_COUNTERS
+    // Deques peak at different times, so the sum of their peaks bounds the peak of the frontier.
+    fprintf(stderr, "peak frontier: at most %zu frames\n", counter_get(&total.peak_frames));
+    fprintf(stderr, "pushes: %zu\npops: %zu\nsteals: %zu, %zu failed, %zu remote\nwaits: %zu, %.3f ms\n",
+            counter_get(&total.pushes), counter_get(&total.pops), counter_get(&total.steals),
+            counter_get(&total.failed_steals), counter_get(&total.remote_steals), counter_get(&total.waits),
+            counter_get(&total.wait_ns) * 1e-6);
+#endif
+    fprintf(stderr, "pool blocks: %zu\n", blocks);
+    if (search->options->affinity != AFFINITY_NONE) {
+        fprintf(stderr, "affinity: %d CPUs on %d nodes, %s steals\n", search->topology.cpus_count,
+                search->topology.nodes_count, search->scheduler.local_steals ? "local" : "any");
+    }
+    if (search->options->visited_bytes) {
+        size_t seen = counter_get(&total.visited_seen);
+        size_t lookups = seen + counter_get(&total.visited_claimed) + counter_get(&total.visited_dropped);
+
+        fprintf(stderr, "visited: %zu lookups, %zu hits (%.1f%%), %zu evicted, %zu dropped, %zu of %zu slots used\n",
+                lookups, seen, lookups ? 100.0 * seen / lookups : 0.0, counter_get(&total.visited_evicted),
+                counter_get(&total.visited_dropped), visited_count(&search->visited),
+                search->visited.buckets * VISITED_BUCKET);
+    }
+    if (search->options->partition_depth >= 0) {
+        fprintf(stderr, "partition: %zu tasks at depth %d, about %.3g nodes, the largest %.3g\n",
+                search->partition_tasks, search->options->partition_depth, search->partition_nodes,
+                search->partition_largest);
+    }
+
+    fprintf(stderr, "%-6s %12s %10s %9s %9s %8s %10s", "thread", "nodes", "pruned", "recursive", "iterative",
+            "donated", "thr. [ms]");
+#if PARALLEL_COUNTERS
+    fprintf(stderr, " %8s %10s %10s %8s %8s %8s %7s %10s", "peak", "pushes", "pops", "steals", "failed", "remote", "waits",
+            "wait [ms]");
+#endif
+    fprintf(stderr, " %7s\n", "blocks");
+
+    for (int i = 0; i < t; ++i) {
+        char name[16];
+        snprintf(name, sizeof(name), "%d", i);
+        stats_print_row(name, &search->scheduler.stats[i], counter_get(&search->pools[i].blocks));
+    }
+
+    if (running) {
+        return;
+    }
+
+    for (int i = 0; i < t; ++i) {
+        RefSumsetPool* pool = &search->pools[i];
+
+        pool_drain_remote(pool); // Count the nodes not taken back yet.
+        fprintf(stderr, "pool %d: high-water %zu nodes, %zu blocks, %zu remote frees\n",
+                i, pool->high_water, counter_get(&pool->blocks), pool->remote_frees);
+    }
+
+    if (search->results) {
+        fprintf(stderr, "results: %zu written to %s\n", search->results->written, search->options->results);
+    }
+
+    if (search->options->checkpoint) {
+        fprintf(stderr, "snapshots: %zu, longest pause %.3f ms\n",
+                search->checkpoint.snapshots, search->checkpoint.longest_pause * 1e3);
+    }
+}
+
+// Print the statistics on every SIGUSR1, until search_join sends the last one.
+static void* dump_thread(void* arg) {
+    Search* search = arg;
+    sigset_t signals;
+    ASSERT_SYS_OK(sigemptyset(&signals));
+    ASSERT_SYS_OK(sigaddset(&signals, SIGUSR1));
+
+    while (true) {
+        int signal;
+        ASSERT_ZERO(sigwait(&signals, &signal));
+
+        if (atomic_load(&search->joined)) {
+            break;
+        }
+
+        fprintf(stderr, "--- %.3f s\n", now() - search->start_time);
+        search_print_stats(search, true);
+    }
+
+    return NULL;
+}
+
+/*
+ * Start the threads on the frames of a snapshot, or on the roots if it is NULL. If the
+ * search has a batch, they start on the roots of all its instances instead. With a static
+ * partition, they start on its tasks below those frames. With an affinity, each thread
+ * is pinned from its start, so its stack and pool blocks are first touched on its node.
+ */
+void search_start(Search* search, const Snapshot* initial) {
+    Checkpoint* checkpoint = &search->checkpoint;
+    search->start_time = now();
+
+    // SIGUSR1 is taken by dump_thread only. It stays blocked in the calling thread,
+    // which the threads created here inherit.
+    sigset_t signals;
+    ASSERT_SYS_OK(sigemptyset(&signals));
+    ASSERT_SYS_OK(sigaddset(&signals, SIGUSR1));
+    ASSERT_ZERO(pthread_sigmask(SIG_BLOCK, &signals, NULL));
+    ASSERT_ZERO(pthread_create(&search->dump_thread, NULL, dump_thread, search));
+
+    if (search->batch) {
+        batch_push_roots(search->batch, &search->scheduler);
+    } else if (initial) {
+        snapshot_restore(initial, checkpoint, &search->scheduler, &search->best_solution, &search->best_sum,
+                         search->input_data, &search->pools[0]);
+    } else {
+        sumset_retain(checkpoint->roots[0]);
+        sumset_retain(checkpoint->roots[1]);
+        scheduler_push(&search->scheduler, 0, (StackFrame){checkpoint->roots[0], checkpoint->roots[1], 0});
+    }
+
+    if (search->options->partition_depth >= 0) {
+        search_partition(search);
+    }
+
+    for (int i = 0; i < search->input_data->t; ++i) {
+        search->thread_args[i] = (ThreadArgs){search->input_data, &search->best_solution, &search->scheduler,
+                                              &search->solution_mutex, &search->best_sum, search->options,
+                                              &search->pools[i], &search->workers[i], i, search->sweep,
+                                              search->start_time, search->results,
+                                              search->options->visited_bytes ? &search->visited : NULL};
+
+        pthread_attr_t attr;
+        ASSERT_ZERO(pthread_attr_init(&attr));
+        if (search->options->affinity != AFFINITY_NONE) {
+            topology_pin(&search->topology, topology_place(&search->topology, search->options->affinity, i), &attr);
+        }
+        ASSERT_ZERO(pthread_create(&search->threads[i], &attr, worker_thread, &search->thread_args[i]));
+        ASSERT_ZERO(pthread_attr_destroy(&attr));
+    }
+}
+
+// Number of nodes expanded so far by all threads.
+static size_t search_nodes(Search* search) {
+    size_t nodes = 0;
+    for (int i = 0; i < search->input_data->t; ++i) {
+        nodes += counter_get(&search->scheduler.stats[i].nodes);
+    }
+
+    return nodes;
+}
+
+/*
+ * Stop the search at a limit. The threads are stopped as for a snapshot; with checkpoints
+ * the frontier is collected then, so that the final snapshot can be resumed.
+ */
+static void search_stop(Search* search, const char* reason) {
+    if (!scheduler_stop(&search->scheduler)) {
+        return; // The search has finished.
+    }
+
+    if (search->options->checkpoint) {
+        search->frontier_count = snapshot_collect(&search->checkpoint, &search->scheduler, &search->frontier);
+    }
+
+    search->stop_reason = reason;
+    scheduler_abort(&search->scheduler);
+}
+
+// Write a duration in seconds as text, in the largest unit it has at least one of.
+static void duration_format(double seconds, char* buffer, size_t size) {
+    if (seconds < 60) {
+        snprintf(buffer, size, "%.0f s", seconds);
+    } else if (seconds < 3600) {
+        snprintf(buffer, size, "%.1f min", seconds / 60);
+    } else if (seconds < 86400) {
+        snprintf(buffer, size, "%.1f h", seconds / 3600);
+    } else {
+        snprintf(buffer, size, "%.1f days", seconds / 86400);
+    }
+}
+
+/*
+ * Print a progress line on stderr: the nodes expanded so far and their rate, and the size
+ * of the tree and the time left, as estimated by walks pruned with the best sum found so
+ * far. The walks add up over the lines, until the best sum changes.
+ */
+static void search_progress(Search* search, TreeEstimate* estimate, unsigned int* seed) {
+    int best_sum = atomic_load(&search->best_sum);
+
+    if (best_sum != estimate->best_sum) {
+        tree_estimate_init(estimate, best_sum, search->options->prune);
+    }
+    for (int k = 0; k < PROGRESS_WALKS; ++k) {
+        tree_estimate_walk(estimate, search->input_data, seed);
+    }
+
+    double elapsed = now() - search->start_time;
+    double nodes = (double)search_nodes(search);
+    double total = tree_estimate_nodes(estimate);
+    double rate = nodes / elapsed;
+
+    if (total > nodes && rate > 0) {
+        char eta[32];
+        duration_format((total - nodes) / rate, eta, sizeof(eta));
+        fprintf(stderr, "progress %.1f s: %.0f nodes, %.3g nodes/s, about %.3g nodes in total (%.0f%%), ETA %s\n",
+                elapsed, nodes, rate, total, 100 * nodes / total, eta);
+    } else {
+        fprintf(stderr, "progress %.1f s: %.0f nodes, %.3g nodes/s, past the estimate of %.3g nodes\n",
+                elapsed, nodes, rate, total);
+    }
+}
+
+/*
+ * Take snapshots and print progress lines at the configured intervals, and stop the search
+ * at its limits, until the search finishes. Run by the main thread, which polls the node limit.
+ */
+void search_watch(Search* search) {
+    const Options* options = search->options;
+    Scheduler* scheduler = &search->scheduler;
+    double next_snapshot = options->checkpoint ? search->start_time + options->interval : INFINITY;
+    double next_progress = options->progress ? search->start_time + options->progress : INFINITY;
+    double deadline = options->time_limit ? search->start_time + options->time_limit : INFINITY;
+    TreeEstimate estimate;
+    unsigned int seed = 1;
+
+    tree_estimate_init(&estimate, -1, options->prune);
+
+    ASSERT_ZERO(pthread_mutex_lock(&scheduler->mutex));
+
+    while (!atomic_load(&scheduler->done)) {
+        double wake = fmin(fmin(next_snapshot, next_progress), deadline);
+        if (options->node_limit) {
+            wake = fmin(wake, now() + LIMIT_POLL_MS * 1e-3);
+        }
+
+        struct timespec wake_time;
+        wake_time.tv_sec = (time_t)wake;
+        wake_time.tv_nsec = (long)((wake - wake_time.tv_sec) * 1e9);
+
+        int err = 0;
+        while (!atomic_load(&scheduler->done) && err != ETIMEDOUT) {
+            err = pthread_cond_timedwait(&scheduler->paused_cond, &scheduler->mutex, &wake_time);
+            if (err != 0 && err != ETIMEDOUT) {
+                syserr("pthread_cond_timedwait");
+            }
+        }
+
+        if (err != ETIMEDOUT) {
+            continue;
+        }
+
+        ASSERT_ZERO(pthread_mutex_unlock(&scheduler->mutex));
+
+        double time = now();
+        if (time >= deadline) {
+            search_stop(search, "time limit");
+        } else if (options->node_limit && search_nodes(search) >= options->node_limit) {
+            search_stop(search, "node limit");
+        } else if (time >= next_snapshot) {
+            snapshot_take(&search->checkpoint, scheduler, search->input_data, options);
+            next_snapshot += options->interval;
+        } else if (time >= next_progress) {
+            search_progress(search, &estimate, &seed);
+            next_progress += options->progress;
+        }
+
+        ASSERT_ZERO(pthread_mutex_lock(&scheduler->mutex));
+    }
+
+    ASSERT_ZERO(pthread_mutex_unlock(&scheduler->mutex));
+}
+
+// Wait for all threads to finish.
+void search_join(Search* search) {
+    for (int i = 0; i < search->input_data->t; ++i) {
+        ASSERT_ZERO(pthread_join(search->threads[i], NULL));
+    }
+
+    atomic_store(&search->joined, true);
+    ASSERT_ZERO(pthread_kill(search->dump_thread, SIGUSR1));
+    ASSERT_ZERO(pthread_join(search->dump_thread, NULL));
+}
+
+// Write the solutions kept besides the best one to the results file. The threads must have finished.
+static void search_write_results(Search* search) {
+    Results* results = search->results;
+
+    if (!results_write(&results->merged, results->spill, search->options->results, &results->written)) {
+        syserr("Cannot write %s", search->options->results);
+    }
+}
+
+// Build a snapshot holding no frames, only the best solution. The threads must have finished.
+void search_result(Search* search, Snapshot* snapshot) {
+    StackFrame* frames;
+    size_t frames_count = snapshot_collect(&search->checkpoint, &search->scheduler, &frames);
+
+    snapshot_init(snapshot, search->input_data);
+    snapshot_fill(snapshot, &search->checkpoint, frames, frames_count, true);
+}
+
+// Free all resources of a finished search.
+void search_destroy(Search* search) {
+    Checkpoint* checkpoint = &search->checkpoint;
+
+    for (int i = 0; i < search->input_data->t; ++i) {
+        sumset_release(NULL, search->workers[i].best.a);
+        sumset_release(NULL, search->workers[i].best.b);
+    }
+    sumset_release(NULL, checkpoint->best.a);
+    sumset_release(NULL, checkpoint->best.b);
+    free(checkpoint->roots[0]);
+    free(checkpoint->roots[1]);
+
+    for (int i = 0; i < search->input_data->t; ++i) {
+        pool_destroy(&search->pools[i]);
+    }
+    free(search->pools);
+    free(search->workers);
+    free(search->threads);
+    free(search->thread_args);
+
+    scheduler_destroy(&search->scheduler);
+    ASSERT_ZERO(pthread_mutex_destroy(&search->solution_mutex));
+
+    if (search->options->affinity != AFFINITY_NONE) {
+        topology_destroy(&search->topology);
+    }
+
+    if (search->results) {
+        result_heap_destroy(&search->results->merged);
+        if (search->results->spill) {
+            fclose(search->results->spill);
+        }
+        ASSERT_ZERO(pthread_mutex_destroy(&search->results->mutex));
+        free(search->results);
+    }
+
+    if (search->options->visited_bytes) {
+        visited_destroy(&search->visited);
+    }
+}
+
+/*
+ * Functions for the estimator.
+ * A short run of the search measures the machine's rate and finds a good best sum, then
+ * walks of common/tree_estimate.h pruned with that sum estimate the size of the whole tree.
+ */
+
+// Print the estimated size and running time of the search on stdout, instead of solving it.
+void estimate_run(InputData* input_data, const Options* options) {
+    Options calibration = *options;
+    if (!calibration.time_limit && !calibration.node_limit) {
+        calibration.time_limit = ESTIMATE_CALIBRATION;
+    }
+
+    Search search;
+    search_init(&search, input_data, &calibration);
+    search_start(&search, NULL);
+    search_watch(&search);
+    search_join(&search);
+
+    double time = now() - search.start_time;
+    size_t nodes = search_nodes(&search);
+    int best_sum = atomic_load(&search.best_sum);
+    bool finished = !search.stop_reason;
+    double rate = nodes / time;
+
+    search_destroy(&search);
+
+    printf("calibration: %zu nodes in %.3f s with %d threads, %.3g nodes/s, best sum %d%s\n", nodes, time,
+           input_data->t, rate, best_sum, finished ? ", search finished" : "");
+
+    TreeEstimate estimate;
+    unsigned int seed = 1;
+    double start = now();
+
+    tree_estimate_init(&estimate, best_sum, options->prune);
+    for (size_t k = 0; k < options->estimate_walks; ++k) {
+        tree_estimate_walk(&estimate, input_data, &seed);
+    }
+
+    double total = tree_estimate_nodes(&estimate);
+    char runtime[32];
+    duration_format(total / rate, runtime, sizeof(runtime));
+
+    printf("estimate: %.3g nodes, standard error %.2g, from %zu walks in %.3f s\n", total,
+           tree_estimate_error(&estimate), estimate.walks, now() - start);
+    printf("runtime: about %s with %d threads\n", runtime, input_data->t);
+}
+
+/*
+ * Functions for the d sweep.
+ * The tree for d is the part of the tree for d + 1 without the element d + 1, and a
+ * solution for d is one for d + 1 as well. So a single search for the last d solves all
+ * of them: every pair is expanded once, for all d from its level on, each solution
+ * raises the best sum of the d's it belongs to, and a subtree is pruned once it cannot
+ * beat any of them.
+ */
+
+// Run one search for the sweep's last d. Returns the number of expanded nodes.
+static size_t sweep_solve(InputData* input_data, const Options* options, Sweep* sweep) {
+    Search search;
+    search_init(&search, input_data, options);
+    search.sweep = sweep;
+
+    search_start(&search, NULL);
+    search_join(&search);
+
+    size_t nodes = search_nodes(&search);
+
+    search_destroy(&search);
+    return nodes;
+}
+
+/*
+ * Solve the input for every d from its own to options.sweep_last, printing "d <d>" and the
+ * solution for each. With --stats every d is also solved on its own, for the time saved.
+ */
+void sweep_run(InputData* input_data, const Options* options) {
+    int first = input_data->d;
+    int last = options->sweep_last < first ? first : options->sweep_last;
+    Sweep sweep = {.first = first, .last = last};
+
+    sweep.solutions = malloc(sizeof(Solution) * (last + 1));
+
+    if (!sweep.solutions) {
+        exit(ERROR);
+    }
+
+    for (int d = 0; d <= last; ++d) {
+        atomic_init(&sweep.best_sum[d], 0);
+        solution_init(&sweep.solutions[d]);
+    }
+    ASSERT_ZERO(pthread_mutex_init(&sweep.mutex, NULL));
+
+    input_data->d = last;
+    double start = now();
+    size_t nodes = sweep_solve(input_data, options, &sweep);
+    double sweep_time = now() - start;
+
+    // The best solution for d is the best one of the levels up to d.
+    const Solution* best = &sweep.solutions[first];
+
+    for (int d = first; d <= last; ++d) {
+        if (sweep.solutions[d].sum > best->sum) {
+            best = &sweep.solutions[d];
+        }
+
+        printf("d %d\n", d);
+        solution_print(best);
+    }
+    fflush(stdout);
+
+    if (options->stats) {
+        fprintf(stderr, "sweep: d %d to %d, %.3f s, %zu nodes\n", first, last, sweep_time, nodes);
+
+        double independent_time = 0;
+        for (int d = first; d <= last; ++d) {
+            Search search;
+            input_data->d = d;
+            search_init(&search, input_data, options);
+
+            start = now();
+            search_start(&search, NULL);
+            search_join(&search);
+            double time = now() - start;
+            independent_time += time;
+
+            size_t independent_nodes = search_nodes(&search);
+
+            fprintf(stderr, "d %d on its own: sum %d, %.3f s, %zu nodes\n",
+                    d, search.best_solution.sum, time, independent_nodes);
+            search_destroy(&search);
+        }
+
+        fprintf(stderr, "independent runs: %.3f s, saved %.3f s (%.0f%%)\n", independent_time,
+                independent_time - sweep_time, 100 * (independent_time - sweep_time) / independent_time);
+    }
+
+    input_data->d = first;
+    free(sweep.solutions);
+    ASSERT_ZERO(pthread_mutex_destroy(&sweep.mutex));
+}
+
+
+/*
+ * Functions for batch mode.
+ * Many inputs are solved by one run of the search engine: the roots of all instances
+ * are pushed at the start, and the threads solve frames of any instance they get.
+ */
+
+// Check whether another input follows on stdin, skipping whitespace.
+static bool batch_has_input(void) {
+    int c;
+
+    do {
+        c = getchar();
+    } while (c != EOF && isspace(c));
+
+    if (c == EOF) {
+        return false;
+    }
+
+    ungetc(c, stdin);
+    return true;
+}
+
+// Read all inputs from stdin. The instances are not moved afterwards, the roots refer to them.
+static void batch_read(Batch* batch) {
+    size_t capacity = 0;
+
+    batch->instances = NULL;
+    batch->count = 0;
+
+    while (batch_has_input()) {
+        if (batch->count == capacity) {
+            capacity = capacity ? capacity * 2 : 64;
+            batch->instances = realloc(batch->instances, sizeof(Instance*) * capacity);
+
+            if (!batch->instances) {
+                exit(ERROR);
+            }
+        }
+
+        Instance* instance = malloc(sizeof(Instance));
+
+        if (!instance) {
+            exit(ERROR);
+        }
+
+        input_data_read(&instance->input_data);
+        batch->instances[batch->count++] = instance;
+    }
+}
+
+// Prepare the instances for the search: roots, solutions and pending frames.
+static void batch_init(Batch* batch) {
+    for (size_t k = 0; k < batch->count; ++k) {
+        Instance* instance = batch->instances[k];
+        InputData* input_data = &instance->input_data;
+
+        instance->batch = batch;
+        roots_create(instance->roots, input_data);
+        instance->roots[0]->instance = instance;
+        instance->roots[1]->instance = instance;
+        instance->root_depth = instance->roots[0]->size + instance->roots[1]->size;
+        atomic_init(&instance->best_sum, 0);
+        solution_init(&instance->best_solution);
+        atomic_init(&instance->pending, 1); // The roots' frame.
+        instance->finished = false;
+    }
+
+    ASSERT_ZERO(pthread_mutex_init(&batch->mutex, NULL));
+    ASSERT_ZERO(pthread_cond_init(&batch->finished_cond, NULL));
+}
+
+// Print the solutions of the instances in input order, each as soon as it and all before it are finished.
+static void batch_print(Batch* batch) {
+    for (size_t k = 0; k < batch->count; ++k) {
+        Instance* instance = batch->instances[k];
+
+        ASSERT_ZERO(pthread_mutex_lock(&batch->mutex));
+        while (!instance->finished) {
+            ASSERT_ZERO(pthread_cond_wait(&batch->finished_cond, &batch->mutex));
+        }
+        ASSERT_ZERO(pthread_mutex_unlock(&batch->mutex));
+
+        solution_print(&instance->best_solution);
+        fflush(stdout);
+
+        // No frame of the instance is left, so the roots are its last nodes.
+        free(instance->roots[0]);
+        free(instance->roots[1]);
+        free(instance);
+        batch->instances[k] = NULL;
+    }
+}
+
+/*
+ * Solve every input on stdin with one set of threads, as many as t of the first input.
+ * The solutions are printed in input order, as the instances finish.
+ */
+void batch_run(const Options* options) {
+    Batch batch;
+    batch_read(&batch);
+    batch_init(&batch);
+
+    if (batch.count == 0) {
+        return;
+    }
+
+    // The instances are freed as they are printed, the search keeps a copy of the first input.
+    InputData first = batch.instances[0]->input_data;
+    Search search;
+    search_init(&search, &first, options);
+    search.batch = &batch;
+    search_start(&search, NULL);
+
+    batch_print(&batch);
+    search_join(&search);
+
+    if (options->stats) {
+        fprintf(stderr, "instances: %zu\n", batch.count);
+        search_print_stats(&search, false);
+    }
+
+    search_destroy(&search);
+    ASSERT_ZERO(pthread_mutex_destroy(&batch.mutex));
+    ASSERT_ZERO(pthread_cond_destroy(&batch.finished_cond));
+    free(batch.instances);
+}
+
+
+/*
+ * Functions for the sharded search.
+ * A coordinator process expands the tree to a prefix depth and hands the frames out
+ * to worker processes, each running the engine above on its frames, see shard.h.
+ */
+
+// Send a snapshot as the payload of a message. Returns false if the peer has disconnected.
+static bool snapshot_send(int fd, MessageType type, const Snapshot* snapshot) {
+    char* buffer;
+    size_t length;
+    FILE* stream = open_memstream(&buffer, &length);
+
+    if (!stream) {
+        exit(ERROR);
+    }
+
+    snapshot_print(snapshot, stream);
+    fclose(stream);
+
+    bool ok = message_send(fd, type, buffer, length);
+    free(buffer);
+
+    return ok;
+}
+
+// Parse the snapshot in a message payload. Exits if it is malformed or of another input.
+static void snapshot_parse(Snapshot* snapshot, char* payload, size_t length, const InputData* input_data) {
+    FILE* stream = fmemopen(payload, length, "r");
+
+    if (!stream || !snapshot_scan(snapshot, stream, "message", input_data)) {
+        exit(ERROR);
+    }
+
+    fclose(stream);
+}
+
+// Steal about half of the frames on the deques of a running search and send them to the coordinator.
+static bool shard_split(Search* search, int fd) {
+    Scheduler* scheduler = &search->scheduler;
+    size_t capacity = 1;
+    for (int i = 0; i < scheduler->t; ++i) {
+        capacity += deque_size(&scheduler->deques[i]);
+    }
+
+    StackFrame* frames = malloc(sizeof(StackFrame) * capacity);
+
+    if (!frames) {
+        exit(ERROR);
+    }
+
+    // The oldest frames, at the top of the deques, have the largest subtrees.
+    size_t frames_count = 0;
+    for (int i = 0; i < scheduler->t; ++i) {
+        int64_t wanted = (deque_size(&scheduler->deques[i]) + 1) / 2;
+
+        for (int64_t k = 0; k < wanted && frames_count < capacity; ++k) {
+            if (deque_steal(&scheduler->deques[i], &frames[frames_count])) {
+                frames_count++;
+            }
+        }
+    }
+
+    Snapshot snapshot;
+    snapshot_init(&snapshot, search->input_data);
+    snapshot_fill(&snapshot, &search->checkpoint, frames, frames_count, false);
+
+    bool ok = snapshot_send(fd, MESSAGE_SPLIT, &snapshot);
+    snapshot_destroy(&snapshot);
+
+    return ok;
+}
+
+// Solve the frames of a WORK message, answering split requests meanwhile, and send back DONE.
+static void shard_solve(InputData* input_data, const Options* options, int fd, const Snapshot* work) {
+    int finish_pipe[2];
+    ASSERT_SYS_OK(pipe(finish_pipe));
+
+    Search search;
+    search_init(&search, input_data, options);
+    search.scheduler.finish_fd = finish_pipe[1];
+    search_start(&search, work);
+
+    while (true) {
+        struct pollfd fds[2] = {{finish_pipe[0], POLLIN, 0}, {fd, POLLIN, 0}};
+
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            syserr("poll");
+        }
+
+        if (fds[0].revents) {
+            break; // The search has finished.
+        }
+
+        MessageType type;
+        char* payload;
+        size_t length;
+
+        if (!message_receive(fd, &type, &payload, &length)) {
+            fatal("The coordinator has disconnected");
+        }
+        free(payload);
+
+        if (type != MESSAGE_SPLIT || !shard_split(&search, fd)) {
+            fatal("Unexpected message from the coordinator");
+        }
+    }
+
+    search_join(&search);
+
+    Snapshot result;
+    search_result(&search, &result);
+
+    if (!snapshot_send(fd, MESSAGE_DONE, &result)) {
+        fatal("The coordinator has disconnected");
+    }
+
+    snapshot_destroy(&result);
+    search_destroy(&search);
+
+    ASSERT_SYS_OK(close(finish_pipe[0]));
+    ASSERT_SYS_OK(close(finish_pipe[1]));
+}
+
+// Serve the coordinator on fd until it sends STOP or disconnects.
+void shard_worker(InputData* input_data, const Options* options, int fd) {
+    while (true) {
+        MessageType type;
+        char* payload;
+        size_t length;
+
+        if (!message_receive(fd, &type, &payload, &length)) {
+            break;
+        }
+
+        if (type == MESSAGE_STOP) {
+            free(payload);
+            break;
+        } else if (type == MESSAGE_WORK) {
+            Snapshot work;
+            snapshot_parse(&work, payload, length, input_data);
+            shard_solve(input_data, options, fd, &work);
+            snapshot_destroy(&work);
+        } else if (type == MESSAGE_SPLIT) {
+            // The request crossed our DONE, there is nothing left to split.
+            Snapshot empty;
+            snapshot_init(&empty, input_data);
+            snapshot_send(fd, MESSAGE_SPLIT, &empty);
+            snapshot_destroy(&empty);
+        }
+
+        free(payload);
+    }
+
+    ASSERT_SYS_OK(close(fd));
+}
+
+// A worker process connected to the coordinator.
+typedef struct {
+    int fd;
+    StackFrame work;           // Frame being solved by the worker (NULLs if idle)
+    bool split_pending;        // A SPLIT request awaits an answer
+} ShardClient;
+
+// State of the coordinator.
+typedef struct {
+    InputData* input_data;
+    const Options* options;
+    RefSumsetPool pool;        // Pool of all the coordinator's nodes
+    Checkpoint checkpoint;     // Roots and nodes of the best solution
+    Solution best_solution;
+    StackFrame* pending;       // Frames not handed out yet
+    size_t pending_count;
+    size_t pending_capacity;
+    ShardClient* clients;
+    size_t clients_count;
+    size_t next_split;         // Client to ask for a split next (round robin)
+    size_t tasks;              // Number of WORK messages sent
+    size_t splits;             // Number of SPLIT requests answered
+    size_t split_frames;       // Number of frames received in answers to SPLIT
+} Coordinator;
+
+static void coordinator_add_pending(Coordinator* coordinator, StackFrame frame) {
+    if (coordinator->pending_count == coordinator->pending_capacity) {
+        coordinator->pending_capacity = coordinator->pending_capacity ? coordinator->pending_capacity * 2 : 64;
+        coordinator->pending = realloc(coordinator->pending, sizeof(StackFrame) * coordinator->pending_capacity);
+
+        if (!coordinator->pending) {
+            exit(ERROR);
+        }
+    }
+
+    coordinator->pending[coordinator->pending_count++] = frame;
+}
+
+// Expand the tree from the roots breadth first, down to the prefix depth, into pending.
+static void coordinator_expand_prefix(Coordinator* coordinator) {
+    Checkpoint* checkpoint = &coordinator->checkpoint;
+    Prefix prefix = {coordinator->input_data, coordinator->options->prune, &coordinator->pool, checkpoint,
+                     &coordinator->best_solution, NULL, 0, 0};
+
+    sumset_retain(checkpoint->roots[0]);
+    sumset_retain(checkpoint->roots[1]);
+    prefix_add(&prefix, (StackFrame){checkpoint->roots[0], checkpoint->roots[1], 0});
+    prefix_expand(&prefix, coordinator->options->prefix_depth);
+
+    coordinator->pending = prefix.frames;
+    coordinator->pending_count = prefix.frames_count;
+    coordinator->pending_capacity = prefix.frames_capacity;
+}
+
+// Hand the last pending frame, with the best solution so far, to an idle client.
+static void coordinator_send_work(Coordinator* coordinator, ShardClient* client) {
+    Checkpoint* checkpoint = &coordinator->checkpoint;
+    StackFrame frame = coordinator->pending[--coordinator->pending_count];
+
+    Snapshot snapshot;
+    snapshot_init(&snapshot, coordinator->input_data);
+
+    int a = snapshot_add_ref(&snapshot, checkpoint, frame.a);
+    snapshot_add_frame(&snapshot, a, snapshot_add_ref(&snapshot, checkpoint, frame.b));
+
+    if (checkpoint->best.a) {
+        snapshot.best_sum = checkpoint->best_sum;
+        snapshot.best_a = snapshot_add_ref(&snapshot, checkpoint, checkpoint->best.a);
+        snapshot.best_b = snapshot_add_ref(&snapshot, checkpoint, checkpoint->best.b);
+    }
+
+    client->work = frame; // Kept until DONE, to be handed out again if the worker disconnects.
+    coordinator->tasks++;
+
+    snapshot_send(client->fd, MESSAGE_WORK, &snapshot);
+    snapshot_destroy(&snapshot);
+}
+
+// Give the frame of a client back to pending and forget the client.
+static void coordinator_drop_client(Coordinator* coordinator, size_t index) {
+    ShardClient* client = &coordinator->clients[index];
+
+    if (client->work.a) {
+        coordinator_add_pending(coordinator, client->work);
+    }
+    ASSERT_SYS_OK(close(client->fd));
+
+    coordinator->clients[index] = coordinator->clients[--coordinator->clients_count];
+}
+
+// Handle a message from a client. Returns false if the client has disconnected.
+static bool coordinator_receive(Coordinator* coordinator, ShardClient* client) {
+    MessageType type;
+    char* payload;
+    size_t length;
+
+    if (!message_receive(client->fd, &type, &payload, &length)) {
+        return false;
+    }
+
+    Snapshot snapshot;
+    snapshot_parse(&snapshot, payload, length, coordinator->input_data);
+    free(payload);
+
+    Ref_sumset** nodes = snapshot_nodes(&snapshot, coordinator->checkpoint.roots, &coordinator->pool);
+
+    if (type == MESSAGE_SPLIT) {
+        for (size_t k = 0; k < snapshot.frames_count; ++k) {
+            StackFrame frame = {nodes[snapshot.frames[k].a], nodes[snapshot.frames[k].b], 0};
+
+            sumset_retain(frame.a);
+            sumset_retain(frame.b);
+            coordinator_add_pending(coordinator, frame);
+        }
+
+        client->split_pending = false;
+        coordinator->splits++;
+        coordinator->split_frames += snapshot.frames_count;
+    } else if (type == MESSAGE_DONE) {
+        if (snapshot.best_a >= 0) {
+            checkpoint_record(&coordinator->checkpoint, &coordinator->best_solution, coordinator->input_data,
+                              &coordinator->pool, nodes[snapshot.best_a], nodes[snapshot.best_b]);
+        }
+
+        sumset_release(&coordinator->pool, client->work.a);
+        sumset_release(&coordinator->pool, client->work.b);
+        client->work = (StackFrame){NULL, NULL, 0};
+    }
+
+    snapshot_nodes_release(&snapshot, nodes, &coordinator->pool);
+    snapshot_destroy(&snapshot);
+
+    return true;
+}
+
+/*
+ * Ask a busy client to split its work, if there is no pending frame for an idle one.
+ * At most one request is outstanding, so that the workers are not flooded.
+ */
+static void coordinator_request_split(Coordinator* coordinator) {
+    bool idle = false;
+
+    for (size_t k = 0; k < coordinator->clients_count; ++k) {
+        if (coordinator->clients[k].split_pending) {
+            return;
+        }
+        idle = idle || !coordinator->clients[k].work.a;
+    }
+
+    if (!idle || coordinator->pending_count > 0) {
+        return;
+    }
+
+    for (size_t k = 0; k < coordinator->clients_count; ++k) {
+        ShardClient* client = &coordinator->clients[(coordinator->next_split + k) % coordinator->clients_count];
+
+        if (client->work.a) {
+            coordinator->next_split = (coordinator->next_split + k + 1) % coordinator->clients_count;
+            client->split_pending = message_send(client->fd, MESSAGE_SPLIT, NULL, 0);
+            return;
+        }
+    }
+}
+
+// Check whether every frame has been solved.
+static bool coordinator_finished(const Coordinator* coordinator) {
+    if (coordinator->pending_count > 0) {
+        return false;
+    }
+
+    for (size_t k = 0; k < coordinator->clients_count; ++k) {
+        if (coordinator->clients[k].work.a) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/*
+ * Run the coordinator: expand the prefix, start options->workers local worker processes
+ * and serve them, and any other worker connecting to the socket, until all work is done.
+ */
+void shard_coordinator(InputData* input_data, const Options* options) {
+    Coordinator coordinator = {
+        .input_data = input_data,
+        .options = options,
+        .pending = NULL,
+        .pending_count = 0,
+        .pending_capacity = 0,
+        .clients = NULL,
+        .clients_count = 0,
+        .next_split = 0,
+        .tasks = 0,
+        .splits = 0,
+        .split_frames = 0
+    };
+    pool_init(&coordinator.pool);
+    solution_init(&coordinator.best_solution);
+
+    Checkpoint* checkpoint = &coordinator.checkpoint;
+    *checkpoint = (Checkpoint){.workers = NULL, .best = {NULL, NULL}, .best_sum = 0};
+    roots_create(checkpoint->roots, input_data);
+
+    coordinator_expand_prefix(&coordinator);
+    size_t prefix_frames = coordinator.pending_count;
+
+    // Start the local workers before any thread exists, they inherit the input.
+    int listener = shard_listen(options->coordinator);
+    pid_t* children = malloc(sizeof(pid_t) * (options->workers + 1));
+
+    if (!children) {
+        exit(ERROR);
+    }
+
+    for (int k = 0; k < options->workers; ++k) {
+        ASSERT_SYS_OK(children[k] = fork());
+
+        if (children[k] == 0) {
+            ASSERT_SYS_OK(close(listener));
+            shard_worker(input_data, options, shard_connect(options->coordinator));
+            exit(0);
+        }
+    }
+
+    while (!coordinator_finished(&coordinator)) {
+        for (size_t k = 0; k < coordinator.clients_count && coordinator.pending_count > 0; ++k) {
+            ShardClient* client = &coordinator.clients[k];
+
+            // If the worker is gone, poll reports it and its frame goes back to pending.
+            if (!client->work.a) {
+                coordinator_send_work(&coordinator, client);
+            }
+        }
+        coordinator_request_split(&coordinator);
+
+        size_t fds_count = coordinator.clients_count + 1;
+        struct pollfd* fds = malloc(sizeof(struct pollfd) * fds_count);
+
+        if (!fds) {
+            exit(ERROR);
+        }
+
+        fds[0] = (struct pollfd){listener, POLLIN, 0};
+        for (size_t k = 0; k < coordinator.clients_count; ++k) {
+            fds[k + 1] = (struct pollfd){coordinator.clients[k].fd, POLLIN, 0};
+        }
+
+        // Wake up now and then to retry splits answered with no frames.
+        if (poll(fds, fds_count, SHARD_POLL_MS) < 0 && errno != EINTR) {
+            syserr("poll");
+        }
+
+        // Handle the clients backwards, since dropping one moves the last one in its place.
+        for (size_t k = fds_count - 1; k > 0; --k) {
+            if (fds[k].revents && !coordinator_receive(&coordinator, &coordinator.clients[k - 1])) {
+                coordinator_drop_client(&coordinator, k - 1);
+            }
+        }
+
+        if (fds[0].revents & POLLIN) {
+            int fd = shard_accept(listener);
+
+            if (fd >= 0) {
+                coordinator.clients = realloc(coordinator.clients, sizeof(ShardClient) * (coordinator.clients_count + 1));
+
+                if (!coordinator.clients) {
+                    exit(ERROR);
+                }
+
+                coordinator.clients[coordinator.clients_count++] = (ShardClient){fd, {NULL, NULL, 0}, false};
+            }
+        }
+
+        free(fds);
+    }
+
+    for (size_t k = 0; k < coordinator.clients_count; ++k) {
+        message_send(coordinator.clients[k].fd, MESSAGE_STOP, NULL, 0);
+        ASSERT_SYS_OK(close(coordinator.clients[k].fd));
+    }
+    for (int k = 0; k < options->workers; ++k) {
+        ASSERT_SYS_OK(waitpid(children[k], NULL, 0));
+    }
+    ASSERT_SYS_OK(close(listener));
+    unlink(options->coordinator);
+
+    solution_print(&coordinator.best_solution);
+
+    if (options->stats) {
+        fprintf(stderr, "prefix frames: %zu\ntasks: %zu\nsplits: %zu, %zu frames\n",
+                prefix_frames, coordinator.tasks, coordinator.splits, coordinator.split_frames);
+    }
+
+    sumset_release(&coordinator.pool, checkpoint->best.a);
+    sumset_release(&coordinator.pool, checkpoint->best.b);
+    free(checkpoint->roots[0]);
+    free(checkpoint->roots[1]);
+    pool_destroy(&coordinator.pool);
+    free(coordinator.pending);
+    free(coordinator.clients);
+    free(children);
+}
+
+// Main function.
+int main(int argc, char* argv[]) {
+    Options options;
+    options_parse(&options, argc, argv);
+
+    if (options.batch) {
+        batch_run(&options);
+        return 0;
+    }
+
+    InputData input_data;
+    input_data_read(&input_data);
+
+    if (options.sweep_last) {
+        sweep_run(&input_data, &options);
+        return 0;
+    }
+
+    if (options.coordinator) {
+        shard_coordinator(&input_data, &options);
+        return 0;
+    }
+
+    if (options.worker) {
+        shard_worker(&input_data, &options, shard_connect(options.worker));
+        return 0;
+    }
+
+    if (options.estimate_walks) {
+        estimate_run(&input_data, &options);
+        return 0;
+    }
+
+    Search search;
+    search_init(&search, &input_data, &options);
+
+    if (options.resume) {
+        Snapshot snapshot;
+        if (!snapshot_read(&snapshot, options.resume, &input_data)) {
+            exit(ERROR);
+        }
+
+        search_start(&search, &snapshot);
+        snapshot_destroy(&snapshot);
+    } else {
+        search_start(&search, NULL);
+    }
+
+    if (options.checkpoint || options.time_limit || options.node_limit || options.progress) {
+        search_watch(&search);
+    }
+
+    search_join(&search);
+
+    // The final snapshot holds the frontier left by a limit. Without it, resuming from it only prints the solution.
+    if (options.checkpoint) {
+        if (!search.stop_reason) {
+            search.frontier_count = snapshot_collect(&search.checkpoint, &search.scheduler, &search.frontier);
+        }
+        snapshot_save(&search.checkpoint, search.frontier, search.frontier_count, &input_data, &options);
+    }
+
+    solution_print(&search.best_solution);
+
+    if (search.results) {
+        search_write_results(&search);
+    }
+
+    if (options.time_limit || options.node_limit) {
+        if (search.stop_reason) {
+            fprintf(stderr, "search stopped by the %s after %.3f s and %zu nodes, the solution may not be optimal\n",
+                    search.stop_reason, now() - search.start_time, search_nodes(&search));
+        } else {
+            fprintf(stderr, "search finished after %.3f s and %zu nodes\n", now() - search.start_time,
+                    search_nodes(&search));
+        }
+    }
+
+    if (options.stats) {
+        search_print_stats(&search, false);
+    }
 
-    // Clean up resources.
-    ASSERT_ZERO(pthread_mutex_destroy(&work_queue.mutex));
-    ASSERT_ZERO(pthread_cond_destroy(&work_queue.cond));
-    ASSERT_ZERO(pthread_mutex_destroy(&solution_mutex));
+    search_destroy(&search);
 
     return 0;
 }
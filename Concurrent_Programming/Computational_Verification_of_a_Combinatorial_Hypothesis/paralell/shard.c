@@ -0,0 +1,155 @@
+#include <arpa/inet.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "common/err.h"
+#include "shard.h"
+
+
+// Constants
+enum {
+    ERROR = 1,
+    CONNECT_ATTEMPTS = 100,    // Attempts of shard_connect, 10 ms apart
+    LISTEN_BACKLOG = 64
+};
+
+
+/*
+ * Functions for message transfer.
+ */
+
+// Write all bytes, retrying after interrupts and short writes.
+static bool write_all(int fd, const void* buffer, size_t length) {
+    const char* bytes = buffer;
+
+    while (length > 0) {
+        ssize_t written = send(fd, bytes, length, MSG_NOSIGNAL);
+
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (written <= 0) {
+            return false;
+        }
+
+        bytes += written;
+        length -= written;
+    }
+
+    return true;
+}
+
+// Read exactly length bytes. Returns false on end of file or error.
+static bool read_all(int fd, void* buffer, size_t length) {
+    char* bytes = buffer;
+
+    while (length > 0) {
+        ssize_t received = read(fd, bytes, length);
+
+        if (received < 0 && errno == EINTR) {
+            continue;
+        }
+        if (received <= 0) {
+            return false;
+        }
+
+        bytes += received;
+        length -= received;
+    }
+
+    return true;
+}
+
+bool message_send(int fd, MessageType type, const char* payload, size_t length) {
+    uint32_t header[2] = {htonl((uint32_t)type), htonl((uint32_t)length)};
+
+    return write_all(fd, header, sizeof(header)) && write_all(fd, payload, length);
+}
+
+bool message_receive(int fd, MessageType* type, char** payload, size_t* length) {
+    uint32_t header[2];
+
+    if (!read_all(fd, header, sizeof(header))) {
+        return false;
+    }
+
+    *type = (MessageType)ntohl(header[0]);
+    *length = ntohl(header[1]);
+    *payload = malloc(*length + 1);
+
+    if (!*payload) {
+        exit(ERROR);
+    }
+
+    if (!read_all(fd, *payload, *length)) {
+        free(*payload);
+        return false;
+    }
+    (*payload)[*length] = '\0';
+
+    return true;
+}
+
+
+/*
+ * Functions for the sockets.
+ */
+
+static void shard_address(struct sockaddr_un* address, const char* path) {
+    memset(address, 0, sizeof(*address));
+    address->sun_family = AF_UNIX;
+
+    if (strlen(path) >= sizeof(address->sun_path)) {
+        fatal("Socket path too long: %s", path);
+    }
+    strcpy(address->sun_path, path);
+}
+
+int shard_listen(const char* path) {
+    struct sockaddr_un address;
+    shard_address(&address, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    ASSERT_SYS_OK(fd);
+
+    unlink(path);
+    ASSERT_SYS_OK(bind(fd, (struct sockaddr*)&address, sizeof(address)));
+    ASSERT_SYS_OK(listen(fd, LISTEN_BACKLOG));
+
+    return fd;
+}
+
+int shard_accept(int listener) {
+    int fd;
+
+    do {
+        fd = accept(listener, NULL, NULL);
+    } while (fd < 0 && errno == EINTR);
+
+    return fd;
+}
+
+int shard_connect(const char* path) {
+    struct sockaddr_un address;
+    shard_address(&address, path);
+
+    for (int attempt = 0; attempt < CONNECT_ATTEMPTS; ++attempt) {
+        int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        ASSERT_SYS_OK(fd);
+
+        if (connect(fd, (struct sockaddr*)&address, sizeof(address)) == 0) {
+            return fd;
+        }
+        ASSERT_SYS_OK(close(fd));
+
+        struct timespec delay = {0, 10 * 1000 * 1000};
+        nanosleep(&delay, NULL);
+    }
+
+    syserr("Cannot connect to %s", path);
+}
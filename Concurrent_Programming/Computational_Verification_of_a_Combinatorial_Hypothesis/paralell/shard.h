@@ -0,0 +1,42 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+
+/*
+ * Messages between the coordinator and the worker processes of a sharded search.
+ *
+ * Every message is an 8-byte header, the type and the payload length as 32-bit
+ * big-endian integers, followed by the payload. Payloads are snapshots in the
+ * text format of common/snapshot.h:
+ *
+ *   WORK   coordinator -> worker   frames to solve and the best solution so far
+ *   SPLIT  coordinator -> worker   request for a part of the worker's frames (no payload)
+ *   SPLIT  worker -> coordinator   frames taken from the worker's deques (possibly none)
+ *   DONE   worker -> coordinator   the WORK is finished, payload holds the best solution
+ *   STOP   coordinator -> worker   no more work, the worker exits (no payload)
+ */
+
+typedef enum {
+    MESSAGE_WORK = 1,
+    MESSAGE_SPLIT,
+    MESSAGE_DONE,
+    MESSAGE_STOP
+} MessageType;
+
+// Send a message. Returns false if the peer has disconnected.
+bool message_send(int fd, MessageType type, const char* payload, size_t length);
+
+// Receive a message into a malloc'ed, NUL-terminated payload. Returns false on disconnection.
+bool message_receive(int fd, MessageType* type, char** payload, size_t* length);
+
+// Create a listening Unix socket at path, replacing a stale socket file.
+int shard_listen(const char* path);
+
+// Accept a worker's connection. Returns -1 if it has gone away meanwhile.
+int shard_accept(int listener);
+
+// Connect to the coordinator listening at path, retrying while it starts up.
+int shard_connect(const char* path);
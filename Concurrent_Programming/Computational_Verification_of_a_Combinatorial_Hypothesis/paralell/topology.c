@@ -0,0 +1,171 @@
+#define _GNU_SOURCE
+
+#include <dirent.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common/err.h"
+#include "topology.h"
+
+
+// Constants
+enum {
+    ERROR = 1,
+    CPULIST_SIZE = 4096        // Bytes of a node's cpulist read
+};
+
+
+bool affinity_parse(const char* name, AffinityPolicy* policy) {
+    static const char* const names[] = {"none", "compact", "scatter"};
+
+    for (int k = 0; k < 3; ++k) {
+        if (strcmp(name, names[k]) == 0) {
+            *policy = (AffinityPolicy)k;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static int compare_ints(const void* x, const void* y) {
+    int a = *(const int*)x;
+    int b = *(const int*)y;
+
+    return (a > b) - (a < b);
+}
+
+// Mark the CPUs of a list like "0-3,8,10-11" as being on node.
+static void cpulist_parse(const char* list, int node, int* node_of) {
+    const char* p = list;
+
+    while (true) {
+        char* end;
+        long first = strtol(p, &end, 10);
+        long last = first;
+
+        if (end == p) {
+            break;
+        }
+        if (*end == '-') {
+            p = end + 1;
+            last = strtol(p, &end, 10);
+        }
+
+        for (long cpu = first < 0 ? 0 : first; cpu <= last && cpu < CPU_SETSIZE; ++cpu) {
+            node_of[cpu] = node;
+        }
+
+        if (*end != ',') {
+            break;
+        }
+        p = end + 1;
+    }
+}
+
+// Read the ids of the NUMA nodes, in increasing order. Returns their number, 0 without the sysfs directory.
+static int node_ids_read(int* ids, int capacity) {
+    DIR* dir = opendir("/sys/devices/system/node");
+    int count = 0;
+
+    if (!dir) {
+        return 0;
+    }
+
+    struct dirent* entry;
+    while ((entry = readdir(dir)) && count < capacity) {
+        int id;
+        char rest;
+
+        if (sscanf(entry->d_name, "node%d%c", &id, &rest) == 1) {
+            ids[count++] = id;
+        }
+    }
+    closedir(dir);
+
+    qsort(ids, count, sizeof(int), compare_ints);
+    return count;
+}
+
+void topology_read(Topology* topology) {
+    int node_of[CPU_SETSIZE];  // Position of the node of each CPU among the node ids
+    int ids[CPU_SETSIZE];
+    int ids_count = node_ids_read(ids, CPU_SETSIZE);
+
+    memset(node_of, 0, sizeof(node_of));
+
+    for (int k = 0; k < ids_count; ++k) {
+        char path[64], list[CPULIST_SIZE];
+        snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", ids[k]);
+
+        FILE* file = fopen(path, "r");
+        if (file) {
+            if (fgets(list, sizeof(list), file)) {
+                cpulist_parse(list, k, node_of);
+            }
+            fclose(file);
+        }
+    }
+
+    cpu_set_t allowed;
+    ASSERT_SYS_OK(sched_getaffinity(0, sizeof(allowed), &allowed));
+
+    int count = CPU_COUNT(&allowed);
+    topology->cpus = malloc(sizeof(int) * count);
+    topology->nodes = malloc(sizeof(int) * count);
+    topology->node_first = malloc(sizeof(int) * (count + 1));
+
+    if (!topology->cpus || !topology->nodes || !topology->node_first) {
+        exit(ERROR);
+    }
+
+    // Nodes with no CPU the process may run on (memory-only ones, or excluded by a cpuset) get no number.
+    topology->cpus_count = 0;
+    topology->nodes_count = 0;
+
+    for (int k = 0; k < (ids_count > 0 ? ids_count : 1); ++k) {
+        int first = topology->cpus_count;
+
+        for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+            if (CPU_ISSET(cpu, &allowed) && node_of[cpu] == k) {
+                topology->cpus[topology->cpus_count] = cpu;
+                topology->nodes[topology->cpus_count] = topology->nodes_count;
+                topology->cpus_count++;
+            }
+        }
+
+        if (topology->cpus_count > first) {
+            topology->node_first[topology->nodes_count++] = first;
+        }
+    }
+
+    topology->node_first[topology->nodes_count] = topology->cpus_count;
+}
+
+void topology_destroy(Topology* topology) {
+    free(topology->cpus);
+    free(topology->nodes);
+    free(topology->node_first);
+}
+
+int topology_place(const Topology* topology, AffinityPolicy policy, int id) {
+    if (policy == AFFINITY_COMPACT) {
+        return id % topology->cpus_count;
+    }
+
+    int node = id % topology->nodes_count;
+    int node_cpus = topology->node_first[node + 1] - topology->node_first[node];
+
+    return topology->node_first[node] + (id / topology->nodes_count) % node_cpus;
+}
+
+void topology_pin(const Topology* topology, int index, pthread_attr_t* attr) {
+    cpu_set_t cpus;
+
+    CPU_ZERO(&cpus);
+    CPU_SET(topology->cpus[index], &cpus);
+    ASSERT_ZERO(pthread_attr_setaffinity_np(attr, sizeof(cpus), &cpus));
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <pthread.h>
+#include <stdbool.h>
+
+
+/*
+ * CPUs and NUMA nodes of the machine, for pinning the worker threads.
+ *
+ * The CPUs are those the process may run on (sched_getaffinity), their nodes are read
+ * from /sys/devices/system/node. Nodes are numbered densely from 0 in the order of their
+ * ids, and a CPU found in no node (or a machine without the directory) is on node 0.
+ *
+ *   compact  thread i on the i-th CPU, filling each node before the next one
+ *   scatter  thread i on node i mod (number of nodes), spreading the threads evenly
+ *
+ * Pinned threads keep their memory local by first touch: a pool block is allocated and
+ * linked by its owner, and a thread's stack is first written by the thread itself.
+ */
+
+typedef enum {
+    AFFINITY_NONE,             // Threads are not pinned
+    AFFINITY_COMPACT,
+    AFFINITY_SCATTER
+} AffinityPolicy;
+
+typedef struct {
+    int* cpus;                 // CPUs the process may run on, by node, then by number
+    int* nodes;                // Node of each of them
+    int* node_first;           // Index in cpus of the first CPU of each node, and cpus_count at the end
+    int cpus_count;
+    int nodes_count;
+} Topology;
+
+// Parse the name of a policy. Returns false if there is no such policy.
+bool affinity_parse(const char* name, AffinityPolicy* policy);
+
+// Read the CPUs and nodes of the machine.
+void topology_read(Topology* topology);
+
+void topology_destroy(Topology* topology);
+
+// Index in cpus of the CPU of thread id under the given policy (not AFFINITY_NONE).
+int topology_place(const Topology* topology, AffinityPolicy policy, int id);
+
+// Make the threads created with attr run on the CPU at index in cpus only.
+void topology_pin(const Topology* topology, int index, pthread_attr_t* attr);
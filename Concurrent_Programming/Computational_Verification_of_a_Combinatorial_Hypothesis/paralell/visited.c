@@ -0,0 +1,81 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "visited.h"
+
+
+// Constants
+enum {
+    ERROR = 1,
+    DEPTH_BITS = 6             // Low bits of a slot holding the depth of its pair, plus one
+};
+
+static const uint64_t DEPTH_MASK = (1 << DEPTH_BITS) - 1;
+
+
+void visited_init(VisitedTable* table, size_t bytes, int depth) {
+    size_t bucket_bytes = sizeof(uint64_t) * VISITED_BUCKET;
+
+    table->buckets = 1;
+    while (table->buckets * 2 * bucket_bytes <= bytes) {
+        table->buckets *= 2;
+    }
+    table->depth = depth;
+    table->slots = aligned_alloc(bucket_bytes, table->buckets * bucket_bytes);
+
+    if (!table->slots) {
+        exit(ERROR);
+    }
+
+    memset((void*)table->slots, 0, table->buckets * bucket_bytes);
+}
+
+void visited_destroy(VisitedTable* table) {
+    free((void*)table->slots);
+}
+
+VisitedClaim visited_claim(VisitedTable* table, uint64_t key, int depth) {
+    _Atomic uint64_t* bucket = &table->slots[((key >> DEPTH_BITS) & (table->buckets - 1)) * VISITED_BUCKET];
+    uint64_t tag = key & ~DEPTH_MASK;
+    uint64_t entry = tag | (uint64_t)(depth + 1);
+    int deepest = -1;
+    uint64_t deepest_entry = 0;
+
+    for (int k = 0; k < VISITED_BUCKET; ++k) {
+        uint64_t slot = atomic_load_explicit(&bucket[k], memory_order_relaxed);
+
+        // A thread that loses the free slot to another one sees what the other one wrote.
+        if (slot == 0 && atomic_compare_exchange_strong_explicit(&bucket[k], &slot, entry,
+                                                                 memory_order_relaxed, memory_order_relaxed)) {
+            return VISITED_CLAIMED;
+        }
+
+        if ((slot & ~DEPTH_MASK) == tag) {
+            return VISITED_SEEN;
+        }
+
+        if (deepest < 0 || (slot & DEPTH_MASK) > (deepest_entry & DEPTH_MASK)) {
+            deepest = k;
+            deepest_entry = slot;
+        }
+    }
+
+    // A slot changed by another thread meanwhile is left to it.
+    if ((deepest_entry & DEPTH_MASK) >= (entry & DEPTH_MASK) &&
+        atomic_compare_exchange_strong_explicit(&bucket[deepest], &deepest_entry, entry,
+                                                memory_order_relaxed, memory_order_relaxed)) {
+        return VISITED_EVICTED;
+    }
+
+    return VISITED_DROPPED;
+}
+
+size_t visited_count(const VisitedTable* table) {
+    size_t count = 0;
+
+    for (size_t k = 0; k < table->buckets * VISITED_BUCKET; ++k) {
+        count += atomic_load_explicit(&table->slots[k], memory_order_relaxed) != 0;
+    }
+
+    return count;
+}
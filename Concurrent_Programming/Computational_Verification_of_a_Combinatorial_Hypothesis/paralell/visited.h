@@ -0,0 +1,78 @@
+#pragma once
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+
+/*
+ * Table of the pairs (A, B) near the roots that some thread has started to expand.
+ *
+ * The multiset with the smaller sum is the one extended, so a pair can be reached along
+ * several paths: ({1}, {2}) comes from ({}, {2}) and from ({2}, {}). The subtree of a
+ * pair depends only on the two multisets (and the best sum, which only grows), so a
+ * thread reaching a pair already in the table skips its subtree: it has been explored,
+ * or is being explored by the thread that claimed it.
+ *
+ * A pair is keyed by a 64-bit hash of its two multisets, taken as an unordered pair.
+ * A multiset is hashed as the elements the search added, then its root: the sum, last
+ * element and subset sums of the starting multiset it grew from, all the search reads
+ * of a root. Two roots alike in these have the same subtrees, so from empty starting
+ * multisets ({i}, {}) and ({}, {i}) are one pair. A collision would skip a subtree
+ * that was never explored; with 58 bits of the key kept, it is unlikely for any table
+ * that fits in memory.
+ *
+ * The table is an array of buckets of 8 slots, one cache line each. A slot holds the
+ * key with the depth of the pair (number of elements added to the roots) in its low
+ * bits, or 0. Slots are claimed with a compare-and-swap, so two threads claiming the
+ * same key in a bucket race for the same free slot and only one of them wins. In a
+ * full bucket, the deepest pair is evicted for one no deeper: the subtrees of shallow
+ * pairs are the larger ones. A pair evicted, or never taken in, is only explored again.
+ */
+
+// Constants
+enum {
+    VISITED_BUCKET = 8,        // Slots per bucket
+    VISITED_MAX_DEPTH = 62     // Deepest pair the low bits of a slot can hold
+};
+
+typedef enum {
+    VISITED_SEEN,              // The pair was in the table
+    VISITED_CLAIMED,           // The pair was added to a free slot
+    VISITED_EVICTED,           // The pair replaced a deeper one
+    VISITED_DROPPED            // The bucket was full of shallower pairs, the pair was not added
+} VisitedClaim;
+
+typedef struct {
+    _Atomic uint64_t* slots;   // VISITED_BUCKET slots for each bucket
+    size_t buckets;            // Number of buckets, a power of two
+    int depth;                 // Deepest pair looked up
+} VisitedTable;
+
+// Allocate a table of at most the given number of bytes, for pairs up to the given depth.
+void visited_init(VisitedTable* table, size_t bytes, int depth);
+
+void visited_destroy(VisitedTable* table);
+
+// Look up a pair at the given depth, adding it if it is not in the table.
+VisitedClaim visited_claim(VisitedTable* table, uint64_t key, int depth);
+
+// Number of pairs in the table, exact once no thread adds any.
+size_t visited_count(const VisitedTable* table);
+
+// Mix the bits of x (the finalizer of splitmix64).
+static inline uint64_t visited_mix(uint64_t x) {
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+// Hash of a multiset, given the hash of the elements that follow an element, and the element.
+static inline uint64_t visited_hash_add(uint64_t hash, int element) {
+    return visited_mix(hash + 0x9e3779b97f4a7c15ULL * (uint64_t)(element + 1));
+}
+
+// Key of the unordered pair of multisets with the given hashes.
+static inline uint64_t visited_pair_key(uint64_t a, uint64_t b) {
+    return visited_mix((a < b ? a : b) ^ visited_mix(a < b ? b : a));
+}
@@ -0,0 +1,26 @@
+#!/bin/sh
+# Snapshots and limits stop the threads while most of them, with far more threads than
+# work, fall asleep. Every run must finish, and resuming the last snapshot must give the
+# sum of a run without snapshots.
+set -e
+
+parallel="$1"
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+
+input="24 14 0 0"
+expected=$(echo "$input" | "$parallel" | head -n 1)
+
+for run in 1 2 3 4 5 6 7 8 9 10; do
+    if ! echo "$input" | timeout 60 "$parallel" --checkpoint "$dir/snap" --interval 0.001 > "$dir/out"; then
+        echo "run $run with snapshots did not finish"
+        exit 1
+    fi
+    test "$(head -n 1 "$dir/out")" = "$expected"
+    test "$(echo "$input" | timeout 60 "$parallel" --resume "$dir/snap" | head -n 1)" = "$expected"
+
+    if ! echo "$input" | timeout 60 "$parallel" --node-limit 1000 > /dev/null 2>&1; then
+        echo "run $run with a node limit did not finish"
+        exit 1
+    fi
+done
@@ -0,0 +1,39 @@
+#!/bin/sh
+# Every pair written by --top and --all-optimal must have the stated sum on both sides,
+# with the elements of non-empty starting multisets listed too.
+set -e
+
+parallel="$1"
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+
+check() {
+    awk -F'[:|]' '{
+        a = 0; b = 0
+        n = split($2, xs, " "); for (k = 1; k <= n; ++k) a += xs[k]
+        n = split($3, ys, " "); for (k = 1; k <= n; ++k) b += ys[k]
+        if (a != $1 || b != $1) { print "bad pair: " $0; bad = 1 }
+    } END { exit bad }' "$1"
+    test -s "$1"
+}
+
+for input in "2 10 0 0" "3 14 0 0"; do
+    echo "$input" | "$parallel" --top 20 --results "$dir/top" > /dev/null
+    check "$dir/top"
+    test "$(wc -l < "$dir/top")" -eq 20
+
+    echo "$input" | "$parallel" --all-optimal --results "$dir/optimal" > /dev/null
+    check "$dir/optimal"
+    best=$(echo "$input" | "$parallel" | head -n 1)
+    test "$(cut -d: -f1 "$dir/optimal" | sort -u)" = "$best"
+done
+
+for input in "2 8 1 1 2 3" "2 10 2 1 1 4 3" "3 12 2 2 5 5 2 7"; do
+    echo "$input" | "$parallel" --top 5 --results "$dir/top" > /dev/null
+    check "$dir/top"
+
+    echo "$input" | "$parallel" --all-optimal --results "$dir/optimal" > /dev/null
+    check "$dir/optimal"
+    best=$(echo "$input" | "$parallel" | head -n 1)
+    test "$(cut -d: -f1 "$dir/optimal" | sort -u)" = "$best"
+done
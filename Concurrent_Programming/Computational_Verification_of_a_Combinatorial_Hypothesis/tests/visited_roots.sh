@@ -0,0 +1,20 @@
+#!/bin/sh
+# --visited must find the best sum of the search without it, also from starting multisets
+# that differ, whose pairs the table must not mistake for one another.
+set -e
+
+parallel="$1"
+
+for input in "2 6 2 0\n1 1\n\n" "2 6 0 2\n\n1 1\n" "2 9 1 1\n2\n3\n" "3 12 2 1\n1 3\n2\n" "2 10 1 0\n4\n\n" \
+             "4 14 0 0\n\n\n"; do
+    expected=$(printf "$input" | "$parallel" | head -n 1)
+
+    for depth in 4 8; do
+        got=$(printf "$input" | "$parallel" --visited 1 --visited-depth $depth | head -n 1)
+
+        if [ "$got" != "$expected" ]; then
+            echo "input '$input', depth $depth: best sum $got with --visited, $expected without"
+            exit 1
+        fi
+    done
+done